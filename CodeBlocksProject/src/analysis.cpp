@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#include "analysis.h"
+#include <string.h>	//memcmp(), memcpy()
+#ifdef __APPLE__
+    #include <SDL/SDL_thread.h>
+#else
+    #include <SDL_thread.h>
+#endif
+#ifdef _WIN32
+	#include <process.h>	//_getpid()
+	#define getpid _getpid
+#else
+	#include <unistd.h>		//getpid()
+#endif
+
+analysis_cache::analysis_cache(const char *dir, Uint64 k)
+{
+	key = k;
+	header = NULL;
+	sections = NULL;
+
+	//the name is just the key, split in two so it prints the same everywhere
+	char name[32];
+	sprintf(name, "%08x%08x.tsa", (unsigned int)(key >> 32), (unsigned int)(key & 0xffffffff));
+	filename = dir;
+	if(!filename.empty() && filename[filename.size() - 1] != '/' && filename[filename.size() - 1] != '\\')
+		filename += "/";
+	filename += name;
+}
+
+analysis_cache::~analysis_cache()
+{
+	file.close();
+}
+
+Uint64 analysis_cache::hash(Uint64 hash, const void *data, size_t size)
+{
+	const Uint8 *bytes = (const Uint8*) data;
+	for(size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool analysis_cache::load()
+{
+	header = NULL;
+	sections = NULL;
+	if(!file.open(filename.c_str()))
+		return false;
+
+	//make sure it's a whole file of this version made for this key before using any of it
+	const analysis_header *h = (const analysis_header*) file.getData();
+	size_t size = file.getSize();
+	bool ok = size >= sizeof(analysis_header);
+	ok = ok && memcmp(h->magic, ANALYSIS_MAGIC, 4) == 0 && h->version == ANALYSIS_VERSION;
+	ok = ok && h->byteOrder == ANALYSIS_BYTE_ORDER && h->key == key && h->fileSize == size;
+	ok = ok && sizeof(analysis_header) + (Uint64)h->sections * sizeof(analysis_section) <= size;
+
+	const analysis_section *s = (const analysis_section*)(file.getData() + sizeof(analysis_header));
+	for(Uint32 i = 0; ok && i < h->sections; i++)
+		ok = s[i].offset % ANALYSIS_ALIGN == 0 && s[i].offset <= size && s[i].size <= size - s[i].offset;
+
+	if(!ok)
+	{
+		debug("The analysis in %s doesn't match this input, it will be made again\n", filename.c_str());
+		file.close();
+		return false;
+	}
+
+	header = h;
+	sections = s;
+	return true;
+}
+
+const analysis_cache::analysis_section *analysis_cache::find(Uint32 kind, Uint32 level)
+{
+	for(Uint32 i = 0; header && i < header->sections; i++)
+		if(sections[i].kind == kind && sections[i].level == level)
+			return &sections[i];
+	return NULL;
+}
+
+gauss_pyramid *analysis_cache::makePyramid(SDL_Surface *input)
+{
+	//level 0 is the input itself, the rest are in the file until one isn't
+	vector<SDL_Surface*> upper;
+	SDL_PixelFormat *f = input->format;
+	const analysis_section *s = NULL;
+	for(int l = 1; (s = find(ANALYSIS_PIXELS, l)); l++)
+	{
+		if(s->size != (Uint64)s->a * s->b * 4)
+			break;
+
+		//the surface only points at the mapped pixels, freeing it leaves them alone.
+		//the input levels are never written to, which is good because the mapping is read only.
+		SDL_Surface *level = SDL_CreateRGBSurfaceFrom((void*)getData(s), s->a, s->b, 32, s->a * 4, f->Rmask, f->Gmask, f->Bmask, f->Amask);
+		if(!level)
+			break;
+		upper.push_back(level);
+	}
+
+	if(upper.empty() || find(ANALYSIS_PIXELS, upper.size() + 1))
+	{
+		for(int l = 0; l < upper.size(); l++)
+			SDL_FreeSurface(upper[l]);
+		return NULL;
+	}
+	return new gauss_pyramid(input, upper);
+}
+
+hood_pyramid *analysis_cache::makeHoods(const hood_settings *settings, gauss_pyramid *pyramid, bool square)
+{
+	Uint32 kind = square ? ANALYSIS_SQUARE_HOODS : ANALYSIS_HOODS;
+	vector<const Uint8*> data(pyramid->getLevels());
+	for(int l = 0; l < pyramid->getLevels(); l++)
+	{
+		const analysis_section *s = find(kind, l);
+		if(!s)
+			return NULL;
+		data[l] = getData(s);
+	}
+
+	//the pyramid works out how big every level should be, it has to agree with the file
+	hood_pyramid *hoods = new hood_pyramid(settings, pyramid, data, square);
+	for(int l = 0; l < hoods->getLevels(); l++)
+	{
+		const analysis_section *s = find(kind, l);
+		if(s->a != hoods->getColors(l) || s->b != hoods->getStride(l) || s->size != (Uint64)hoods->getWidth(l) * hoods->getHeight(l) * hoods->getStride(l))
+		{
+			delete hoods;
+			return NULL;
+		}
+	}
+	return hoods;
+}
+
+similarity_sets *analysis_cache::makeSimilaritySets(hood_pyramid *hoods, int k)
+{
+	vector<const int*> data(hoods->getLevels());
+	for(int l = 0; l < hoods->getLevels(); l++)
+	{
+		const analysis_section *s = find(ANALYSIS_SIMILAR, l);
+		if(!s || s->a != k || s->size != (Uint64)hoods->getWidth(l) * hoods->getHeight(l) * k * sizeof(int))
+			return NULL;
+		data[l] = (const int*) getData(s);
+	}
+	return new similarity_sets(hoods, k, data);
+}
+
+tsvq *analysis_cache::makeTree(hood_pyramid *hoods, int l)
+{
+	const analysis_section *nodes = find(ANALYSIS_TSVQ_NODES, l);
+	const analysis_section *indices = find(ANALYSIS_TSVQ_INDICES, l);
+	const analysis_section *centroids = find(ANALYSIS_TSVQ_CENTROIDS, l);
+	if(!nodes || !indices || !centroids || nodes->a == 0)
+		return NULL;
+
+	Uint64 count = nodes->a;
+	if(nodes->size != count * sizeof(tsvq::tsvq_node) || centroids->size != count * hoods->getStride(l)
+		|| indices->size != (Uint64)hoods->getWidth(l) * hoods->getHeight(l) * sizeof(int))
+		return NULL;
+
+	return new tsvq(hoods, l, (const tsvq::tsvq_node*) getData(nodes), nodes->a, (const int*) getData(indices), getData(centroids));
+}
+
+bool analysis_cache::save(gauss_pyramid *pyramid, hood_pyramid *hoods, hood_pyramid *squareHoods, similarity_sets *similar, tsvq **trees)
+{
+	//work out what goes where first, the table comes before all of it
+	vector<analysis_section> table;
+	vector<const void*> data;
+	analysis_section s;
+
+	for(int l = 1; l < pyramid->getLevels(); l++)
+	{
+		//the pixels are copied row by row below since the surface's rows can have padding
+		SDL_Surface *level = pyramid->getLevel(l);
+		s.kind = ANALYSIS_PIXELS; s.level = l; s.a = level->w; s.b = level->h;
+		s.size = (Uint64)level->w * level->h * 4;
+		table.push_back(s);
+		data.push_back(level);
+	}
+
+	for(int n = 0; n < 2; n++)
+	{
+		hood_pyramid *h = (n == 0) ? hoods : squareHoods;
+		for(int l = 0; h && l < h->getLevels(); l++)
+		{
+			s.kind = (n == 0) ? ANALYSIS_HOODS : ANALYSIS_SQUARE_HOODS; s.level = l;
+			s.a = h->getColors(l); s.b = h->getStride(l);
+			s.size = (Uint64)h->getWidth(l) * h->getHeight(l) * h->getStride(l);
+			table.push_back(s);
+			data.push_back(h->getLevelData(l));
+		}
+	}
+
+	//the sets belong to the square neighborhoods if there are any
+	hood_pyramid *setHoods = squareHoods ? squareHoods : hoods;
+	for(int l = 0; similar && l < setHoods->getLevels(); l++)
+	{
+		s.kind = ANALYSIS_SIMILAR; s.level = l; s.a = similar->getK(); s.b = 0;
+		s.size = (Uint64)setHoods->getWidth(l) * setHoods->getHeight(l) * similar->getK() * sizeof(int);
+		table.push_back(s);
+		data.push_back(similar->getSet(l, 0));
+	}
+
+	for(int l = 0; trees && l < hoods->getLevels(); l++)
+	{
+		s.level = l; s.a = trees[l]->getNodes(); s.b = 0;
+		s.kind = ANALYSIS_TSVQ_NODES;
+		s.size = (Uint64)trees[l]->getNodes() * sizeof(tsvq::tsvq_node);
+		table.push_back(s);
+		data.push_back(trees[l]->getNodeData());
+		s.kind = ANALYSIS_TSVQ_INDICES;
+		s.size = (Uint64)hoods->getWidth(l) * hoods->getHeight(l) * sizeof(int);
+		table.push_back(s);
+		data.push_back(trees[l]->getIndexData());
+		s.kind = ANALYSIS_TSVQ_CENTROIDS;
+		s.size = (Uint64)trees[l]->getNodes() * hoods->getStride(l);
+		table.push_back(s);
+		data.push_back(trees[l]->getCentroidData());
+	}
+
+	Uint64 offset = sizeof(analysis_header) + table.size() * sizeof(analysis_section);
+	for(int i = 0; i < table.size(); i++)
+	{
+		offset = (offset + ANALYSIS_ALIGN - 1) / ANALYSIS_ALIGN * ANALYSIS_ALIGN;
+		table[i].offset = offset;
+		offset += table[i].size;
+	}
+
+	analysis_header h;
+	memcpy(h.magic, ANALYSIS_MAGIC, 4);
+	h.version = ANALYSIS_VERSION;
+	h.byteOrder = ANALYSIS_BYTE_ORDER;
+	h.sections = table.size();
+	h.key = key;
+	h.fileSize = offset;
+
+	//write it somewhere else first so nobody maps half a file. every thread of every process
+	//that might be saving the same analysis has a file of its own.
+	char suffix[64];
+	sprintf(suffix, ".%lu.%lu.tmp", (unsigned long)getpid(), (unsigned long)SDL_ThreadID());
+	string temp = filename + suffix;
+	FILE *out = fopen(temp.c_str(), "wb");
+	if(!out)
+	{
+		debug("WARNING: couldn't open %s to save the analysis\n", temp.c_str());
+		return false;
+	}
+
+	bool ok = fwrite(&h, sizeof(h), 1, out) == 1;
+	ok = ok && (table.empty() || fwrite(&table[0], sizeof(analysis_section), table.size(), out) == table.size());
+	Uint64 written = sizeof(analysis_header) + table.size() * sizeof(analysis_section);
+	static const char zeros[ANALYSIS_ALIGN] = { 0 };
+	for(int i = 0; ok && i < table.size(); i++)
+	{
+		ok = fwrite(zeros, 1, table[i].offset - written, out) == table[i].offset - written;
+		if(table[i].kind == ANALYSIS_PIXELS)
+		{
+			SDL_Surface *level = (SDL_Surface*) data[i];
+			for(int y = 0; ok && y < level->h; y++)
+				ok = fwrite((Uint8*)level->pixels + y * level->pitch, 4, level->w, out) == level->w;
+		}
+		else
+			ok = ok && fwrite(data[i], 1, table[i].size, out) == table[i].size;
+		written = table[i].offset + table[i].size;
+	}
+	ok = (fclose(out) == 0) && ok;
+
+	//another run might have saved the same thing in the meantime, that's fine too.
+	//rename() replaces it in one go everywhere but windows, which won't rename over a file.
+#ifdef _WIN32
+	remove(filename.c_str());
+#endif
+	ok = ok && rename(temp.c_str(), filename.c_str()) == 0;
+	if(!ok)
+	{
+		debug("WARNING: couldn't write the analysis to %s\n", filename.c_str());
+		remove(temp.c_str());
+	}
+	return ok;
+}
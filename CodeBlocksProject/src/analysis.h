@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#ifndef ANALYSIS_H_INCLUDED
+#define ANALYSIS_H_INCLUDED
+
+/*
+ * This file contains the on-disk cache of the analysis of an input texture: everything that
+ * is worked out from the input before synthesis starts (the levels of its gaussian pyramid,
+ * the neighborhoods of every level and the search indices built over them). None of it
+ * depends on anything but the input's pixels and the settings, so each file is named after a
+ * hash of both. A later run with the same input and settings maps the file into memory and
+ * uses the sections right where they are, nothing is parsed or copied.
+ *
+ * The file is a header, a table of sections and then the sections, each one starting on a
+ * multiple of ANALYSIS_ALIGN bytes so the neighborhoods in them are aligned for the ssd
+ * kernels. It's written in the byte order of the machine that made it.
+ */
+
+#ifdef __APPLE__
+    #include <SDL/SDL.h>
+#else
+    #include <SDL.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <string>
+#include "util.h"			//debug()
+#include "mappedfile.h"		//mapped_file class
+#include "gauss_pyramid.h"	//gauss_pyramid class
+#include "hood.h"			//hood_pyramid class
+#include "kcoherence.h"		//similarity_sets class
+#include "tsvq.h"			//tsvq class
+
+using namespace std;
+
+//the first bytes of an analysis file and the version of its layout
+#define ANALYSIS_MAGIC "TSAN"
+#define ANALYSIS_VERSION 4
+//written as it is, so a file from a machine with the other byte order won't match
+#define ANALYSIS_BYTE_ORDER 0x01020304
+//every section starts on a multiple of this many bytes
+#define ANALYSIS_ALIGN HOOD_ALIGN
+//what hash() starts from
+#define ANALYSIS_HASH_START 14695981039346656037ULL
+
+//the kinds of sections. each one is for one level.
+#define ANALYSIS_PIXELS			0	//the 32 bit pixels of a pyramid level above level 0, in rows
+#define ANALYSIS_HOODS			1	//the neighborhoods of a level (hood_pyramid)
+#define ANALYSIS_SQUARE_HOODS	2	//the square neighborhoods of a level (hood_pyramid)
+#define ANALYSIS_SIMILAR		3	//the similarity sets of a level
+#define ANALYSIS_TSVQ_NODES		4	//the nodes of a level's tsvq tree
+#define ANALYSIS_TSVQ_INDICES	5	//the neighborhood indices of a level's tsvq tree
+#define ANALYSIS_TSVQ_CENTROIDS	6	//the codewords of a level's tsvq tree
+
+class analysis_cache
+{
+public:
+	//the cache file for key in the directory dir. nothing is read until load() is called.
+	analysis_cache(const char *dir, Uint64 key);
+	~analysis_cache();
+
+	//FNV-1a hash of size bytes of data, carrying on from hash (start with ANALYSIS_HASH_START)
+	static Uint64 hash(Uint64 hash, const void *data, size_t size);
+
+	//maps the file into memory. returns false if there isn't one or it wasn't made by this
+	//version for this key.
+	bool load();
+
+	inline bool isLoaded()
+	{
+		return header != NULL;
+	}
+
+	inline const char *getFilename()
+	{
+		return filename.c_str();
+	}
+
+	//writes the analysis to the file for the next run. anything but pyramid and hoods can be
+	//NULL if it wasn't made. trees has one tree per level of hoods.
+	bool save(gauss_pyramid *pyramid, hood_pyramid *hoods, hood_pyramid *squareHoods, similarity_sets *similar, tsvq **trees);
+
+	//these make the parts of the analysis out of the mapped file. they all return NULL if that
+	//part isn't in the file or doesn't fit, then it has to be made the slow way.
+	//the file has to stay loaded as long as what they make is used.
+	gauss_pyramid *makePyramid(SDL_Surface *input);
+	hood_pyramid *makeHoods(const hood_settings *s, gauss_pyramid *pyramid, bool square);
+	similarity_sets *makeSimilaritySets(hood_pyramid *hoods, int k);
+	tsvq *makeTree(hood_pyramid *hoods, int l);
+
+private:
+	struct analysis_header
+	{
+		char magic[4];
+		Uint32 version;
+		Uint32 byteOrder;
+		Uint32 sections;
+		Uint64 key;
+		Uint64 fileSize;
+	};
+
+	struct analysis_section
+	{
+		Uint32 kind, level;
+		//what these are depends on the kind: width and height for pixels, colors and stride
+		//for neighborhoods, k for similarity sets and the node count for tsvq sections
+		Uint32 a, b;
+		Uint64 offset, size;
+	};
+
+	//returns the section of the given kind for level, NULL if it's not in the file
+	const analysis_section *find(Uint32 kind, Uint32 level);
+
+	//returns where the data of section s is in the mapped file
+	inline const Uint8 *getData(const analysis_section *s)
+	{
+		return file.getData() + s->offset;
+	}
+
+	string filename;
+	Uint64 key;
+	mapped_file file;
+	const analysis_header *header;
+	const analysis_section *sections;
+};
+
+#endif // ANALYSIS_H_INCLUDED
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "fft.h"
+#include <math.h>	//cos(), sin()
+#ifndef M_PI
+	#define M_PI 3.14159265358979323846
+#endif
+
+//how many columns a column task copies out and transforms at a time
+#define FFT_COLUMN_GROUP 8
+
+int fft_plan::sizeFor(int n)
+{
+	int size = 1;
+	while(size < n)
+		size *= 2;
+	return size;
+}
+
+fft_plan::fft_plan(int size)
+{
+	n = size;
+
+	int bits = 0;
+	while((1 << bits) < n)
+		bits++;
+	reversed.resize(n);
+	for(int i = 0; i < n; i++)
+	{
+		int r = 0;
+		for(int b = 0; b < bits; b++)
+			if(i & (1 << b))
+				r |= 1 << (bits - 1 - b);
+		reversed[i] = r;
+	}
+
+	//work the twiddles out directly instead of multiplying them up so they stay accurate
+	twiddles.resize(MAX(n / 2, 1));
+	for(int k = 0; k < n / 2; k++)
+		twiddles[k] = fft_complex(cos(2 * M_PI * k / n), -sin(2 * M_PI * k / n));
+}
+
+void fft_plan::transform(fft_complex *data, int stride, bool inverse) const
+{
+	for(int i = 0; i < n; i++)
+	{
+		int r = reversed[i];
+		if(i < r)
+		{
+			fft_complex tmp = data[i * stride];
+			data[i * stride] = data[r * stride];
+			data[r * stride] = tmp;
+		}
+	}
+
+	//cooley-tukey butterflies, the twiddles are conjugated for the inverse
+	for(int len = 2; len <= n; len *= 2)
+	{
+		int half = len / 2, step = n / len;
+		for(int start = 0; start < n; start += len)
+		{
+			for(int k = 0; k < half; k++)
+			{
+				fft_complex w = inverse ? conj(twiddles[k * step]) : twiddles[k * step];
+				fft_complex &a = data[(start + k) * stride];
+				fft_complex &b = data[(start + k + half) * stride];
+				fft_complex t = w * b;
+				b = a - t;
+				a += t;
+			}
+		}
+	}
+}
+
+fft_2d::fft_2d(int w, int h) : rows(w), columns(h)
+{
+}
+
+void fft_2d::transform(fft_complex *grid, bool inverse, worker_pool *pool) const
+{
+	pass p;
+	p.plan = this;
+	p.grid = grid;
+	p.inverse = inverse;
+
+	int w = getWidth(), h = getHeight();
+	int groups = (w + FFT_COLUMN_GROUP - 1) / FFT_COLUMN_GROUP;
+	if(pool)
+	{
+		pool->run(transformRow, (void*)&p, h);
+		pool->run(transformColumns, (void*)&p, groups);
+	}
+	else
+	{
+		for(int y = 0; y < h; y++)
+			transformRow(y, (void*)&p);
+		for(int c = 0; c < groups; c++)
+			transformColumns(c, (void*)&p);
+	}
+}
+
+void fft_2d::transformRow(int y, void *data)
+{
+	pass *p = (pass*) data;
+	p->plan->rows.transform(p->grid + (size_t)y * p->plan->getWidth(), 1, p->inverse);
+}
+
+void fft_2d::transformColumns(int c, void *data)
+{
+	pass *p = (pass*) data;
+	int w = p->plan->getWidth(), h = p->plan->getHeight();
+	int first = c * FFT_COLUMN_GROUP, count = MIN(FFT_COLUMN_GROUP, w - first);
+
+	//the columns are a whole row apart, copy a few of them next to each other first
+	//so the transform isn't jumping all over memory
+	vector<fft_complex> columns((size_t)count * h);
+	for(int y = 0; y < h; y++)
+		for(int i = 0; i < count; i++)
+			columns[(size_t)i * h + y] = p->grid[(size_t)y * w + first + i];
+
+	for(int i = 0; i < count; i++)
+		p->plan->columns.transform(&columns[(size_t)i * h], 1, p->inverse);
+
+	for(int y = 0; y < h; y++)
+		for(int i = 0; i < count; i++)
+			p->grid[(size_t)y * w + first + i] = columns[(size_t)i * h + y];
+}
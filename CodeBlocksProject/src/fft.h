@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef FFT_H_INCLUDED
+#define FFT_H_INCLUDED
+
+/*
+ * This file contains a small radix-2 fast fourier transform, just enough to do the
+ * two dimensional correlations the fft search needs without pulling in a library.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <complex>
+#include <vector>
+#include "util.h"			//debug()
+#include "worker_pool.h"	//worker_pool class
+
+using namespace std;
+
+typedef complex<double> fft_complex;
+
+//transforms of one power of two size along one dimension
+class fft_plan
+{
+public:
+	//n must be a power of two
+	fft_plan(int n);
+
+	//transforms the n values at data, data + stride, data + 2 * stride...
+	//in place. the inverse isn't scaled by 1 / n.
+	void transform(fft_complex *data, int stride, bool inverse) const;
+
+	inline int getSize() const
+	{
+		return n;
+	}
+
+	//returns the smallest power of two that is at least n
+	static int sizeFor(int n);
+
+private:
+	int n;
+	//where every value goes in the bit reversed order
+	vector<int> reversed;
+	//e^(-2 pi i k / n) for k in [0, n / 2)
+	vector<fft_complex> twiddles;
+};
+
+//transforms of a w x h grid stored in scanline order, both powers of two
+class fft_2d
+{
+public:
+	fft_2d(int w, int h);
+
+	//transforms grid in place, forwards or backwards (again not scaled). the rows and then
+	//the columns are split up between the threads of pool if it isn't NULL.
+	void transform(fft_complex *grid, bool inverse, worker_pool *pool) const;
+
+	inline int getWidth() const
+	{
+		return rows.getSize();
+	}
+	inline int getHeight() const
+	{
+		return columns.getSize();
+	}
+
+private:
+	//the worker pool runs these for every row and every group of columns
+	static void transformRow(int y, void *data);
+	static void transformColumns(int c, void *data);
+
+	fft_plan rows, columns;
+
+	//what the row and column tasks are working on
+	struct pass
+	{
+		const fft_2d *plan;
+		fft_complex *grid;
+		bool inverse;
+	};
+};
+
+#endif // FFT_H_INCLUDED
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "fftsearch.h"
+#include <math.h>	//floor()
+
+fft_search::fft_search(const hood_settings *s, gauss_pyramid *inPyramid, int l, worker_pool *pool)
+{
+	SDL_Surface *level = inPyramid->getLevel(l);
+	w = level->w;
+	h = level->h;
+
+	//the correlation only knows about the shape of this level's neighborhoods
+	hood::offsets(s, l, xOffsets, yOffsets);
+	usable = (int)xOffsets.size() == hood::countColors(s, inPyramid, l);
+	if(!usable)
+	{
+		debug("WARNING: the neighborhoods on level %d don't fit the fft search\n", l);
+		plan = NULL;
+		return;
+	}
+
+	minX = minY = 0;
+	int maxX = 0, maxY = 0;
+	for(int i = 0; i < xOffsets.size(); i++)
+	{
+		minX = MIN(minX, xOffsets[i]);
+		minY = MIN(minY, yOffsets[i]);
+		maxX = MAX(maxX, xOffsets[i]);
+		maxY = MAX(maxY, yOffsets[i]);
+	}
+
+	//the input wrapped around far enough that no neighborhood goes off the edge. making the
+	//grid at least this big means the correlation never wraps around on its own.
+	int extW = w + maxX - minX, extH = h + maxY - minY;
+	plan = new fft_2d(fft_plan::sizeFor(extW), fft_plan::sizeFor(extH));
+	int gw = plan->getWidth(), gh = plan->getHeight();
+	verboseDebug("\tfft search grid for level %d is %d x %d\n", l, gw, gh);
+
+	//the weighted channels of the wrapped input, and the sum of their squares for the table
+	vector<Uint64> table((size_t)(extW + 1) * (extH + 1), 0);
+	image_view<Uint32> pixels = surfaceView(level);
+	for(int c = 0; c < HOOD_CHANNELS; c++)
+		channels[c].assign((size_t)gw * gh, fft_complex(0, 0));
+	for(int y = 0; y < extH; y++)
+	{
+		Uint64 rowSum = 0;
+		for(int x = 0; x < extW; x++)
+		{
+			Uint8 rgb[HOOD_CHANNELS];
+			unpackRGB(pixels.wrapped(x + minX, y + minY), level->format, &rgb[0], &rgb[1], &rgb[2]);
+			for(int c = 0; c < HOOD_CHANNELS; c++)
+			{
+				Uint8 v = s->weigh(c, rgb[c]);
+				channels[c][(size_t)y * gw + x] = fft_complex(v, 0);
+				rowSum += (Uint64)v * v;
+			}
+			table[(size_t)(y + 1) * (extW + 1) + x + 1] = table[(size_t)y * (extW + 1) + x + 1] + rowSum;
+		}
+	}
+	for(int c = 0; c < HOOD_CHANNELS; c++)
+		plan->transform(&channels[c][0], false, pool);
+
+	//the shape is made of runs of pixels in a row, add up each run from the table
+	norms.assign((size_t)w * h, 0);
+	for(int i = 0; i < xOffsets.size(); )
+	{
+		int j = i + 1;
+		while(j < xOffsets.size() && yOffsets[j] == yOffsets[i] && xOffsets[j] == xOffsets[j - 1] - 1)
+			j++;
+		int x0 = xOffsets[j - 1] - minX, x1 = xOffsets[i] - minX + 1, row = yOffsets[i] - minY;
+		for(int y = 0; y < h; y++)
+			for(int x = 0; x < w; x++)
+			{
+				const Uint64 *top = &table[(size_t)(y + row) * (extW + 1)];
+				const Uint64 *bottom = top + extW + 1;
+				norms[(size_t)y * w + x] += bottom[x + x1] - bottom[x + x0] - top[x + x1] + top[x + x0];
+			}
+		i = j;
+	}
+}
+
+fft_search::~fft_search()
+{
+	delete plan;
+}
+
+size_t fft_search::getMemoryUse() const
+{
+	size_t total = norms.size() * sizeof(Uint64);
+	for(int c = 0; c < HOOD_CHANNELS; c++)
+		total += channels[c].size() * sizeof(fft_complex);
+	return total;
+}
+
+void fft_search::distances(const Uint8 *target, Uint64 *d, worker_pool *pool, buffers *b) const
+{
+	int gw = plan->getWidth(), gh = plan->getHeight();
+	vector<fft_complex> &work = b->work, &scratch = b->scratch;
+	work.resize((size_t)gw * gh);
+	scratch.resize((size_t)gw * gh);
+
+	//sum(out * in) for every input pixel is the correlation of the target's shape with the
+	//input. it is linear, so the products of all the channels are added up before going back.
+	Uint64 targetNorm = 0;
+	for(int c = 0; c < HOOD_CHANNELS; c++)
+	{
+		fill(scratch.begin(), scratch.end(), fft_complex(0, 0));
+		for(int i = 0; i < xOffsets.size(); i++)
+		{
+			Uint8 v = target[i * HOOD_CHANNELS + c];
+			scratch[(size_t)(yOffsets[i] - minY) * gw + xOffsets[i] - minX] = fft_complex(v, 0);
+			targetNorm += (Uint64)v * v;
+		}
+		plan->transform(&scratch[0], false, pool);
+
+		for(size_t i = 0; i < work.size(); i++)
+		{
+			fft_complex product = channels[c][i] * conj(scratch[i]);
+			work[i] = (c == 0) ? product : work[i] + product;
+		}
+	}
+	plan->transform(&work[0], true, pool);
+
+	distance_task task;
+	task.search = this;
+	task.work = &work[0];
+	task.targetNorm = targetNorm;
+	task.out = d;
+	pool->run(finishRow, (void*)&task, h);
+}
+
+void fft_search::finishRow(int y, void *data)
+{
+	distance_task *t = (distance_task*) data;
+	const fft_search *s = t->search;
+	double scale = 1.0 / ((double)s->plan->getWidth() * s->plan->getHeight());
+	const fft_complex *row = &t->work[(size_t)y * s->plan->getWidth()];
+
+	for(int x = 0; x < s->w; x++)
+	{
+		//everything in the correlation is an integer, so it rounds back to the exact answer
+		Sint64 product = (Sint64)floor(row[x].real() * scale + 0.5);
+		Sint64 d = (Sint64)t->targetNorm - 2 * product + (Sint64)s->norms[(size_t)y * s->w + x];
+		t->out[(size_t)y * s->w + x] = (d > 0) ? (Uint64)d : 0;
+	}
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef FFTSEARCH_H_INCLUDED
+#define FFTSEARCH_H_INCLUDED
+
+/*
+ * This file contains the fft search. The distance from one output neighborhood to the
+ * neighborhood of every input pixel is
+ *		sum(out^2) - 2 * sum(out * in) + sum(in^2)
+ * The middle term for every input pixel at once is a correlation of the neighborhood's
+ * shape with the input level, which is done with ffts. The last one only depends on the
+ * input so it is worked out once per level with a summed-area table. All of it comes out
+ * as exact integers, the same ones the ssd kernels give.
+ */
+
+#ifdef __APPLE__
+    #include <SDL/SDL.h>
+#else
+    #include <SDL.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "util.h"			//debug()
+#include "sdl.h"			//surfaceView()
+#include "gauss_pyramid.h"	//gauss_pyramid class
+#include "hood.h"			//hood class
+#include "fft.h"			//fft_2d class
+#include "worker_pool.h"	//worker_pool class
+
+using namespace std;
+
+class fft_search
+{
+public:
+	//the scratch space one distances() call works in. every thread that searches at the
+	//same time needs its own, the search itself is never changed after it is made.
+	struct buffers
+	{
+		vector<fft_complex> work, scratch;
+	};
+
+	//gets level l of inPyramid ready to be searched for neighborhoods built with the settings s.
+	//the ffts are split up between the threads of pool.
+	fft_search(const hood_settings *s, gauss_pyramid *inPyramid, int l, worker_pool *pool);
+	~fft_search();
+
+	//returns false if the neighborhoods on this level aren't just the shape from
+	//hood::offsets(), like when they have pixels from other levels in them too
+	inline bool isUsable()
+	{
+		return usable;
+	}
+
+	//returns about how many bytes the transforms of the input level take up
+	size_t getMemoryUse() const;
+
+	//fills in distances[y * width + x] with the distance between target (the unpacked
+	//channels of an output neighborhood on this level) and the neighborhood of every
+	//input pixel (x, y). the work is split up between the threads of pool.
+	void distances(const Uint8 *target, Uint64 *distances, worker_pool *pool, buffers *b) const;
+
+private:
+	//what the distance tasks of one distances() call are working on
+	struct distance_task
+	{
+		const fft_search *search;
+		const fft_complex *work;
+		Uint64 targetNorm;
+		Uint64 *out;
+	};
+
+	//the worker pool runs this for every row of the distance map
+	static void finishRow(int y, void *data);
+
+	fft_2d *plan;
+	bool usable;
+
+	//size of the input level
+	int w, h;
+	//where the shape's pixels are compared to the pixel they belong to
+	vector<int> xOffsets, yOffsets;
+	int minX, minY;
+
+	//the transform of every weighted channel of the input level, wrapped around so that
+	//every neighborhood is all in one piece
+	vector<fft_complex> channels[HOOD_CHANNELS];
+	//sum(in^2) of the neighborhood of every input pixel
+	vector<Uint64> norms;
+};
+
+#endif // FFTSEARCH_H_INCLUDED
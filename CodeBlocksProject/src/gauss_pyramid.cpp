@@ -17,30 +17,36 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
-#include "gauss_pyramid.h"
+#include "gauss_pyramid.h"
+#include "sdl.h"	//createSurface()
 
-void gaussianBlur(SDL_Surface *input, int filterRadius)
-{
-	if(filterRadius <= 0)	return;
- 	int gaussWidth = filterRadius * 2 + 1;
-
-	verboseDebug("gaussianBlur()\n");
-	SDL_LockSurface(input);
-	Uint32 *inPixels = (Uint32*)input->pixels;
-	int w = input->w, h = input->h;
-	int size = w * h;
+//the vector version of the blur's inner loop only gets built where sse is always there
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define BLUR_SSE
+	#include <xmmintrin.h>
+#endif
 
-	//data for each pass of the gaussian blur
-	Uint32 *xPass = new Uint32[size];
-	Uint32 *yPass = new Uint32[size];
-	for(int i=0; i < size; i++)
-		xPass[i] = yPass[i] = 0;
+//acc[i] += k * src[i] for the n values of a row. every value is worked out the same way
+//by both versions so they give exactly the same answer.
+static inline void addScaled(float *acc, const float *src, float k, int n)
+{
+	int i = 0;
+#ifdef BLUR_SSE
+	__m128 vk = _mm_set1_ps(k);
+	for(; i + 4 <= n; i += 4)
+		_mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(_mm_loadu_ps(src + i), vk)));
+#endif
+	for(; i < n; i++)
+		acc[i] += k * src[i];
+}
 
-	//generate the kernel
-	verboseDebug("\tGenerating Kernel\n");
-	float *K = new float[gaussWidth];
+//fills in the 2 * radius + 1 weights of the blur, adding up to 1
+static void blurKernel(int radius, vector<float> &K)
+{
+	int gaussWidth = radius * 2 + 1;
+	K.resize(gaussWidth);
 	float mean = (float)gaussWidth / (float)GAUSS_SD;
-	for(int i=0; i < filterRadius + 1; i++)
+	for(int i=0; i < radius + 1; i++)
 	{
 		K[i] = (float) pow( sin((((i + 1) * M_PI_2 ) - mean) / gaussWidth) ,2.0) * GAUSS_SD;
 		//mirror that value
@@ -48,97 +54,373 @@ void gaussianBlur(SDL_Surface *input, int filterRadius)
 	}
 	float gaussSum = 0.0;
 	for(int i=0; i < gaussWidth; i++) gaussSum += K[i];
+	//fold the division into the weights
+	for(int i=0; i < gaussWidth; i++) K[i] /= gaussSum;
+}
 
-	//frequently used variables
-	Uint8 sourceR, sourceG, sourceB;
-	Uint8 destR, destG, destB;
-	int shift, dest, source;
+//the horizontal pass over the w pixels of row. they're unpacked into padded, a row of w + 2 * r
+//for every channel with r copies of the edge pixels on each side, and channel c is blurred
+//into out[c].
+static void blurAcross(const Uint32 *row, int w, const SDL_PixelFormat *format, int r, const float *kernel, vector<float> *padded, float *const *out)
+{
+	for(int x = -r; x < w + r; x++)
+	{
+		Uint8 rgb[3];
+		unpackRGB(row[clampCoordinate(x, w)], format, &rgb[0], &rgb[1], &rgb[2]);
+		for(int c = 0; c < 3; c++)
+			padded[c][x + r] = rgb[c];
+	}
+
+	for(int c = 0; c < 3; c++)
+	{
+		for(int x = 0; x < w; x++)
+			out[c][x] = 0;
+		for(int k = 0; k <= 2 * r; k++)
+			addScaled(out[c], &padded[c][k], kernel[k], w);
+	}
+}
+
+//the vertical pass for one row. taps[c * (2 * r + 1) + k] is channel c of the horizontal pass
+//of the row k - r away from it and sums has room for w values of every channel. the blurred
+//row is packed into out.
+static void blurDown(const float *const *taps, int w, int r, const float *kernel, vector<float> *sums, Uint32 *out, const SDL_PixelFormat *format)
+{
+	for(int c = 0; c < 3; c++)
+	{
+		float *acc = &sums[c][0];
+		for(int x = 0; x < w; x++)
+			acc[x] = 0;
+		for(int k = 0; k <= 2 * r; k++)
+			addScaled(acc, taps[c * (2 * r + 1) + k], kernel[k], w);
+	}
 
-	//let's do it!
-	verboseDebug("\tRunning horizontal pass\n");
 	for(int x = 0; x < w; x++)
 	{
-		for( int y = 0; y < h; y++ )
+		Uint8 rgb[3];
+		for(int c = 0; c < 3; c++)
+			rgb[c] = (Uint8)MIN(sums[c][x] + 0.5f, 255.0f);
+		out[x] = packRGB(rgb[0], rgb[1], rgb[2], format);
+	}
+}
+
+//what the blur tasks share. each task does the rows [h * t / numTasks, h * (t + 1) / numTasks).
+struct blur_data
+{
+	image_view<Uint32> pixels;
+	const SDL_PixelFormat *format;
+	int radius, numTasks;
+	//the 2 * radius + 1 weights, adding up to 1
+	const float *kernel;
+	//the red, green and blue planes after the horizontal pass
+	float *planes[3];
+};
+
+//unpacks the task's rows into planes and runs the horizontal pass over them
+static void blurRows(int t, void *data)
+{
+	blur_data *dat = (blur_data*)data;
+	int w = dat->pixels.getWidth(), h = dat->pixels.getHeight(), r = dat->radius;
+	int from = h * t / dat->numTasks, to = h * (t + 1) / dat->numTasks;
+
+	//one channel of a row with radius copies of the edge pixels on each side
+	vector<float> padded[3];
+	for(int c = 0; c < 3; c++)
+		padded[c].resize(w + 2 * r);
+
+	for(int y = from; y < to; y++)
+	{
+		float *out[3];
+		for(int c = 0; c < 3; c++)
+			out[c] = dat->planes[c] + (size_t)y * w;
+		blurAcross(dat->pixels.row(y), w, dat->format, r, dat->kernel, padded, out);
+	}
+}
+
+//runs the vertical pass over the task's rows and packs them back into the surface
+static void blurColumns(int t, void *data)
+{
+	blur_data *dat = (blur_data*)data;
+	int w = dat->pixels.getWidth(), h = dat->pixels.getHeight(), r = dat->radius;
+	int from = h * t / dat->numTasks, to = h * (t + 1) / dat->numTasks;
+
+	vector<float> sums[3];
+	for(int c = 0; c < 3; c++)
+		sums[c].resize(w);
+	vector<const float*> taps(3 * (2 * r + 1));
+
+	for(int y = from; y < to; y++)
+	{
+		for(int c = 0; c < 3; c++)
+			for(int k = 0; k <= 2 * r; k++)
+				taps[c * (2 * r + 1) + k] = dat->planes[c] + (size_t)clampCoordinate(y + k - r, h) * w;
+		blurDown(&taps[0], w, r, dat->kernel, sums, dat->pixels.row(y), dat->format);
+	}
+}
+
+void gaussianBlur(SDL_Surface *input, int filterRadius, worker_pool *pool)
+{
+	if(filterRadius <= 0)	return;
+
+	verboseDebug("gaussianBlur()\n");
+	SDL_LockSurface(input);
+	int w = input->w, h = input->h;
+	size_t size = (size_t)w * h;
+
+	//generate the kernel
+	verboseDebug("\tGenerating Kernel\n");
+	vector<float> K;
+	blurKernel(filterRadius, K);
+
+	blur_data dat;
+	dat.pixels = surfaceView(input);
+	dat.format = input->format;
+	dat.radius = filterRadius;
+	dat.kernel = &K[0];
+	vector<float> planes(size * 3);
+	for(int c = 0; c < 3; c++)
+		dat.planes[c] = &planes[size * c];
+
+	//one task per thread, but no more than there are rows
+	dat.numTasks = pool ? MIN(MAX(pool->getThreads(), 1), h) : 1;
+
+	//the vertical pass needs the rows above and below, so all of the
+	//horizontal pass has to be done before it starts
+	verboseDebug("\tRunning horizontal pass\n");
+	if(pool)
+		pool->run(blurRows, (void*)&dat, dat.numTasks);
+	else
+		blurRows(0, (void*)&dat);
+	verboseDebug("\tRunning vertical pass\n");
+	if(pool)
+		pool->run(blurColumns, (void*)&dat, dat.numTasks);
+	else
+		blurColumns(0, (void*)&dat);
+
+	//unlock the surfaces
+	SDL_UnlockSurface(input);
+	verboseDebug("done.\n");
+}
+
+row_blur::row_blur(int width, int height, int r)
+{
+	w = width;
+	h = height;
+	radius = MAX(r, 0);
+	blurKernel(radius, kernel);
+	rows.resize((size_t)3 * (2 * radius + 1) * w);
+	taps.resize(3 * (2 * radius + 1));
+	for(int c = 0; c < 3; c++)
+	{
+		padded[c].resize(w + 2 * radius);
+		sums[c].resize(w);
+	}
+}
+
+void row_blur::add(int y, const Uint32 *row, const SDL_PixelFormat *format)
+{
+	float *out[3];
+	for(int c = 0; c < 3; c++)
+		out[c] = &rows[((size_t)(y % (2 * radius + 1)) * 3 + c) * w];
+	blurAcross(row, w, format, radius, &kernel[0], padded, out);
+}
+
+void row_blur::get(int y, Uint32 *out, const SDL_PixelFormat *format)
+{
+	//the rows past the edges are the ones on the edge, like gaussianBlur()'s
+	for(int c = 0; c < 3; c++)
+		for(int k = 0; k <= 2 * radius; k++)
+			taps[c * (2 * radius + 1) + k] = &rows[((size_t)(clampCoordinate(y + k - radius, h) % (2 * radius + 1)) * 3 + c) * w];
+	blurDown(&taps[0], w, radius, &kernel[0], sums, out, format);
+}
+
+//the 16 bit integer loops of shrinkLevel() need sse2
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define SHRINK_SSE2
+	#include <emmintrin.h>
+#endif
+
+//what the shrink tasks share. each task does the output rows [h * t / numTasks, h * (t + 1) / numTasks).
+struct shrink_data
+{
+	image_view<Uint32> in, out;
+	const SDL_PixelFormat *format;
+	int numTasks;
+	//the red, green and blue of the input, w * h each
+	Uint16 *planes[3];
+	//where the red, green and blue of the output go too, outW * outH each, or NULL
+	Uint16 *next[3];
+};
+
+//unpacks the task's share of the input rows into the planes
+static void unpackRows(int t, void *data)
+{
+	shrink_data *dat = (shrink_data*)data;
+	int w = dat->in.getWidth(), h = dat->in.getHeight();
+	for(int y = h * t / dat->numTasks; y < h * (t + 1) / dat->numTasks; y++)
+	{
+		Uint32 *row = dat->in.row(y);
+		Uint16 *r = dat->planes[0] + (size_t)y * w, *g = dat->planes[1] + (size_t)y * w, *b = dat->planes[2] + (size_t)y * w;
+		for(int x = 0; x < w; x++)
 		{
-			dest = y * w + x;
-
-			//go through the kernel
-			for(int k=0; k < gaussWidth; k++)
-			{
-				// Get pixel-shift (pixel dist between dest and source)
-				shift = k - filterRadius;
-
-				// Basic edge clamp
-				source = y * w + (x + shift);
-				if(x + shift <= 0 || x + shift >= w)
-					source = dest;
-
-				// Read source pixel through kernel matrix from pixels[array]
-				SDL_GetRGB(inPixels[source], input->format, &sourceR, &sourceG, &sourceB);
-
-				//combine source and dest pixels with gaussian weight
-				SDL_GetRGB(xPass[dest], input->format, &destR, &destG, &destB);
-				destR += Uint8( (sourceR * K[k]) / gaussSum);
-				destG += Uint8( (sourceG * K[k]) / gaussSum);
-				destB += Uint8( (sourceB * K[k]) / gaussSum);
-
-				//store that value in the output
-				xPass[dest] = SDL_MapRGB(input->format, destR, destG, destB);
-			}
+			Uint8 rgb[3];
+			unpackRGB(row[x], dat->format, &rgb[0], &rgb[1], &rgb[2]);
+			r[x] = rgb[0];
+			g[x] = rgb[1];
+			b[x] = rgb[2];
 		}
 	}
-	verboseDebug("\tRunning vertical pass\n");
-	for(int x = 0; x < w; x++)
+}
+
+//sum[x] = r0[x] + 4 r1[x] + 6 r2[x] + 4 r3[x] + r4[x] for the n values of a row.
+//that's at most 16 * 255 so it fits in 16 bits.
+static inline void binomialColumns(Uint16 *sum, const Uint16 *r0, const Uint16 *r1, const Uint16 *r2, const Uint16 *r3, const Uint16 *r4, int n)
+{
+	int x = 0;
+#ifdef SHRINK_SSE2
+	for(; x + 8 <= n; x += 8)
+	{
+		__m128i outer = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(r0 + x)), _mm_loadu_si128((const __m128i*)(r4 + x)));
+		__m128i inner = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(r1 + x)), _mm_loadu_si128((const __m128i*)(r3 + x)));
+		__m128i center = _mm_loadu_si128((const __m128i*)(r2 + x));
+		//4 inner + 6 center = 4 (inner + center) + 2 center
+		__m128i s = _mm_add_epi16(outer, _mm_slli_epi16(_mm_add_epi16(inner, center), 2));
+		_mm_storeu_si128((__m128i*)(sum + x), _mm_add_epi16(s, _mm_slli_epi16(center, 1)));
+	}
+#endif
+	for(; x < n; x++)
+		sum[x] = r0[x] + 4 * r1[x] + 6 * r2[x] + 4 * r3[x] + r4[x];
+}
+
+#ifdef SHRINK_SSE2
+//the even and the odd values of s[0] to s[15], which have to be less than 32768
+static inline void splitEvenOdd(const Uint16 *s, __m128i *even, __m128i *odd)
+{
+	__m128i a = _mm_loadu_si128((const __m128i*)s), b = _mm_loadu_si128((const __m128i*)(s + 8));
+	__m128i low = _mm_set1_epi32(0xffff);
+	*even = _mm_packs_epi32(_mm_and_si128(a, low), _mm_and_si128(b, low));
+	*odd = _mm_packs_epi32(_mm_srli_epi32(a, 16), _mm_srli_epi32(b, 16));
+}
+#endif
+
+//out[x] = (s[2x] + 4 s[2x+1] + 6 s[2x+2] + 4 s[2x+3] + s[2x+4] + 128) / 256 for the n kept pixels
+//of a row of vertical sums. the weights add up to 256 so that's at most 255, and it's at most
+//256 * 255 + 128 before the divide so it fits in 16 bits too. s has to have 2n + 4 values.
+static inline void binomialRow(Uint16 *out, const Uint16 *s, int n)
+{
+	int x = 0;
+#ifdef SHRINK_SSE2
+	for(; x + 8 <= n; x += 8)
 	{
-		for(int y = 0; y < h; y++)
+		__m128i e0, o1, e2, o3, e4, unused;
+		splitEvenOdd(s + 2 * x, &e0, &o1);
+		splitEvenOdd(s + 2 * x + 2, &e2, &o3);
+		splitEvenOdd(s + 2 * x + 4, &e4, &unused);
+		//4 inner + 6 center = 4 (inner + center) + 2 center, like binomialColumns()
+		__m128i total = _mm_add_epi16(_mm_add_epi16(e0, e4), _mm_slli_epi16(_mm_add_epi16(_mm_add_epi16(o1, o3), e2), 2));
+		total = _mm_add_epi16(total, _mm_slli_epi16(e2, 1));
+		_mm_storeu_si128((__m128i*)(out + x), _mm_srli_epi16(_mm_add_epi16(total, _mm_set1_epi16(128)), 8));
+	}
+#endif
+	for(; x < n; x++)
+		out[x] = (s[2 * x] + 4 * s[2 * x + 1] + 6 * s[2 * x + 2] + 4 * s[2 * x + 3] + s[2 * x + 4] + 128) >> 8;
+}
+
+//filters and decimates the task's share of the output rows
+static void shrinkRows(int t, void *data)
+{
+	shrink_data *dat = (shrink_data*)data;
+	int w = dat->in.getWidth(), h = dat->in.getHeight();
+	int outW = dat->out.getWidth(), outH = dat->out.getHeight();
+
+	//the vertical sums of one output row, with two copies of the edge on each side (and one
+	//more value binomialRow() needs when w is odd), and the output row itself when it doesn't
+	//go straight into dat->next
+	vector<Uint16> sums[3], kept[3];
+	for(int c = 0; c < 3; c++)
+	{
+		sums[c].resize(2 * outW + 4);
+		kept[c].resize(outW);
+	}
+
+	for(int y = outH * t / dat->numTasks; y < outH * (t + 1) / dat->numTasks; y++)
+	{
+		//down first, over the five input rows around 2y
+		int rows[5];
+		for(int k = 0; k < 5; k++)
+			rows[k] = clampCoordinate(2 * y + k - 2, h);
+
+		//then across, only at the pixels that are kept
+		const Uint16 *out[3];
+		for(int c = 0; c < 3; c++)
 		{
-			dest = y * w + x;
-
-			//go through kernel
-			for(int k=0; k < gaussWidth; k++)
-			{
-				shift = k - filterRadius;
-
-				//edge clamp
-				source = (y + shift) * w + x;
-				if( y + shift <= 0 || y + shift >= h)
-					source = dest;
-
-				// Read source pixel through kernel matrix from pixels[array]
-				SDL_GetRGB(xPass[source], input->format, &sourceR, &sourceG, &sourceB);
-
-				//combine source and dest pixels with gaussian weight
-				SDL_GetRGB(yPass[dest], input->format, &destR, &destG, &destB);
-				destR += Uint8( (sourceR * K[k]) / gaussSum);
-				destG += Uint8( (sourceG * K[k]) / gaussSum);
-				destB += Uint8( (sourceB * K[k]) / gaussSum);
-
-				//store that value in the output
-				yPass[dest] = SDL_MapRGB(input->format, destR, destG, destB);
-			}
+			const Uint16 *p = dat->planes[c];
+			Uint16 *sum = &sums[c][2];
+			binomialColumns(sum, p + (size_t)rows[0] * w, p + (size_t)rows[1] * w, p + (size_t)rows[2] * w, p + (size_t)rows[3] * w, p + (size_t)rows[4] * w, w);
+			sum[-2] = sum[-1] = sum[0];
+			sum[w] = sum[w + 1] = sum[w - 1];
+
+			Uint16 *o = dat->next[c] ? dat->next[c] + (size_t)y * outW : &kept[c][0];
+			binomialRow(o, &sums[c][0], outW);
+			out[c] = o;
 		}
+
+		Uint32 *row = dat->out.row(y);
+		for(int x = 0; x < outW; x++)
+			row[x] = packRGB((Uint8)out[0][x], (Uint8)out[1][x], (Uint8)out[2][x], dat->format);
 	}
+}
 
-	verboseDebug("\tSaving data\n");
-	//copy into output data
-	for(int i=0; i < size; i++)
-		inPixels[i] = yPass[i];
+SDL_Surface *shrinkLevel(SDL_Surface *input, worker_pool *pool, vector<Uint16> *planes)
+{
+	int w = input->w, h = input->h;
+	SDL_Surface *output = createSurface(MAX((w + 1) / 2, 1), MAX((h + 1) / 2, 1), input->format);
 
-	//unlock the surfaces
-	SDL_UnlockSurface(input);
-	//SDL_UnlockSurface(output);
+	SDL_LockSurface(input);
+	shrink_data dat;
+	dat.in = surfaceView(input);
+	dat.out = surfaceView(output);
+	dat.format = output->format;
+	dat.numTasks = pool ? MIN(MAX(pool->getThreads(), 1), output->h) : 1;
 
-	verboseDebug("\tCleaning up\n");
+	//the input's planes, if they were kept from making it
+	vector<Uint16> in, next;
+	size_t size = (size_t)w * h, outSize = (size_t)output->w * output->h;
+	bool unpack = !planes || planes->size() != size * 3;
+	if(unpack)
+		in.resize(size * 3);
+	else
+		in.swap(*planes);
+	if(planes)
+		next.resize(outSize * 3);
+	for(int c = 0; c < 3; c++)
+	{
+		dat.planes[c] = &in[size * c];
+		dat.next[c] = planes ? &next[outSize * c] : NULL;
+	}
 
-	//delete those heap-allocated variables
-	delete K;
-	delete xPass;
-	delete yPass;
-	verboseDebug("done.\n");
+	//the output rows read the input rows of the tasks next to theirs,
+	//so all of them have to be unpacked first
+	if(pool)
+	{
+		if(unpack)
+			pool->run(unpackRows, (void*)&dat, dat.numTasks);
+		pool->run(shrinkRows, (void*)&dat, dat.numTasks);
+	}
+	else
+	{
+		if(unpack)
+			unpackRows(0, (void*)&dat);
+		shrinkRows(0, (void*)&dat);
+	}
+	SDL_UnlockSurface(input);
+
+	if(planes)
+		planes->swap(next);
+	return output;
 }
 
-gauss_pyramid::gauss_pyramid(SDL_Surface *source, int levels, bool blur)
-{
+gauss_pyramid::gauss_pyramid(SDL_Surface *source, int levels, bool blur, worker_pool *pool)
+{
 	//get some parameters
 	w = source->w;
 	h = source->h;
@@ -158,15 +440,19 @@ gauss_pyramid::gauss_pyramid(SDL_Surface *source, int levels, bool blur)
 
 	//generate the rest of the surfaces
 	verboseDebug("\tGenerating pyramid levels\n");
+	//the planes of the level that was just made, so the next one doesn't have to unpack it
+	vector<Uint16> planes;
 	for(int i=1; i<t; i++)
 	{
 		verboseDebug("\tShrinking previous level\n");
-		SDL_Surface *thisOne = zoomSurface(pyramid[i-1], 0.5, 0.5, SMOOTHING_ON);
+		SDL_Surface *thisOne = shrinkLevel(pyramid[i-1], pool, i + 1 < t ? &planes : NULL);
 
 		if(blur)
 		{
 			verboseDebug("\tApplying Gaussian Blur\n");
-			gaussianBlur(thisOne);
+			gaussianBlur(thisOne, 4, pool);
+			//the planes are from before the blur
+			planes.clear();
 		}
 
 		pyramid.push_back(thisOne);
@@ -175,6 +461,16 @@ gauss_pyramid::gauss_pyramid(SDL_Surface *source, int levels, bool blur)
 	verboseDebug("done.\n");
 }
 
+gauss_pyramid::gauss_pyramid(SDL_Surface *source, const vector<SDL_Surface*> &upper)
+{
+	w = source->w;
+	h = source->h;
+	t = upper.size() + 1;
+
+	pyramid.push_back(source);
+	pyramid.insert(pyramid.end(), upper.begin(), upper.end());
+}
+
 gauss_pyramid::~gauss_pyramid()
 {
 	//free all the surfaces used in the pyramid except for the one passed
@@ -40,9 +40,8 @@
 #else
     #include <SDL.h>
 #endif
-
-//for zoom functions
-#include <SDL_rotozoom.h>
+#include "image_view.h"		//surfaceView(), unpackRGB()
+#include "worker_pool.h"	//worker_pool class
 
 using namespace std;
 
@@ -50,7 +49,47 @@ using namespace std;
 
 //Takes an input SDL_Surface and applies a gaussian blur to it with the passed parameters
 //Based off of the javascript code here: http://hyper-metrix.com/processing-js/docs/?page=Gaussian%20Blur
-void gaussianBlur(SDL_Surface *input, int radius = 4);
+//the channels are split up into float planes and blurred one row at a time, first across
+//and then down, so every pass walks straight through memory. if pool isn't NULL the rows
+//are split up between its threads. pixels past the edges are the ones on the edge.
+void gaussianBlur(SDL_Surface *input, int radius = 4, worker_pool *pool = NULL);
+
+//the same blur for an image that is only made a row at a time, keeping only the rows it still
+//needs (see tex_syn_context::stream()). the rows of a w x h image are add()ed from the top
+//down, and blurred row y can be had from get() once the radius rows below it are in (or the
+//last one is). get() has to be called for the rows in order too. every row comes out exactly
+//like gaussianBlur() makes it.
+class row_blur
+{
+public:
+	row_blur(int w, int h, int radius = 4);
+
+	//runs the horizontal pass over row y, the next one
+	void add(int y, const Uint32 *row, const SDL_PixelFormat *format);
+
+	//packs blurred row y into out
+	void get(int y, Uint32 *out, const SDL_PixelFormat *format);
+
+private:
+	int w, h, radius;
+	vector<float> kernel;
+	//the last 2 * radius + 1 rows after the horizontal pass, the red, green and blue of
+	//row y are in slot y % (2 * radius + 1)
+	vector<float> rows;
+	//room for the vertical pass
+	vector<const float*> taps;
+	vector<float> padded[3], sums[3];
+};
+
+//returns a new surface half the size of input (rounded up) that is input filtered with the
+//5 tap binomial kernel 1 4 6 4 1 in both directions and then every other pixel of every
+//other row taken, all in one pass. pixels past the edges are the ones on the edge.
+//if pool isn't NULL the rows are split up between its threads.
+//the work is done on 16 bit red, green and blue planes. if planes isn't NULL it's left holding
+//the output's (3 planes of w * h one after the other), and if it already holds input's when
+//it's passed in those get used instead of unpacking input again. that way every level of a
+//pyramid only gets unpacked once.
+SDL_Surface *shrinkLevel(SDL_Surface *input, worker_pool *pool = NULL, vector<Uint16> *planes = NULL);
 
 class gauss_pyramid
 {
@@ -59,8 +98,15 @@ public:
 	//the provided surface becomes the first level of the pyramid (it is not copied)
 	//levels defines how many gaussian levels to use to generate the texture.
 	//if levels is left set to -1, it will automatically decide how many levels to use.
-	//if blur is true, it'll apply a gaussian blur to all levels except for the bottom
-	gauss_pyramid(SDL_Surface *source, int levels = -1, bool blur = false);
+	//every level is made from the one below it by shrinkLevel(), so it is already filtered.
+	//if blur is true, it'll also apply a gaussian blur to all levels except for the bottom.
+	//if pool isn't NULL the rows of every level are split up between its threads.
+	gauss_pyramid(SDL_Surface *source, int levels = -1, bool blur = false, worker_pool *pool = NULL);
+
+	//makes a pyramid out of levels that were already made somewhere else (like an analysis
+	//cache). source becomes level 0 and upper levels 1 and up. the upper levels are freed
+	//with the pyramid just like the ones it makes itself.
+	gauss_pyramid(SDL_Surface *source, const vector<SDL_Surface*> &upper);
 
 	//frees all the surfaces used in the pyramid EXCEPT for the surface
 	//passed for initialization.
@@ -18,41 +18,11 @@
  */
 
 #include "hood.h"
+#include <algorithm>	//swap()
 
-hood::hood(gauss_pyramid *p, int curL, int x, int y, bool d)
+//works out the offsets of the neighborhood shape for a level with the given diameter
+static void buildStencil(int diameter, bool lowest, hood_stencil &stencil)
 {
-    formatSurface = createSurface(1, 1);
-
-	color = getPixel(p->getLevel(curL), x, y);
-
-	//do this for all levels of the pyramid below this one if TEX_SYN_USE_MULTIRESOLUTION is defined
-	int l = curL;
-#ifdef TEX_SYN_USE_MULTIRESOLUTION
-	for(l = p->getLevels() - 1; l >= curL; l--)
-	{
-#endif
-
-		//get this level
-		SDL_Surface *thisLevel = p->getLevel(l);
-
-		//figure out what the scale of this layer is so that the
-		//texton width can be be applied to it
-		float scale = pow(0.5,  l);
-		int useTextonDiameter = (int) ceil(scale * textonDiameter);
-
-		//add this level
-		addLevel(p, l, useTextonDiameter, int(scale * x), int(scale * y), l == curL);
-
-#ifdef TEX_SYN_USE_MULTIRESOLUTION
-	}
-#endif
-
-	if(d) dump(x, y);
-}
-
-void hood::addLevel(gauss_pyramid *p, int curL, int diameter, int x, int y, bool lowest)
-{
-	SDL_Surface *thisLevel = p->getLevel(curL);
 	int halfWidth = (int)sqrt((float)diameter);
 	if(halfWidth == 0) halfWidth++;
 
@@ -67,12 +37,19 @@ void hood::addLevel(gauss_pyramid *p, int curL, int diameter, int x, int y, bool
 		//for all levels that arn't the lowest, sample a whole square
 		goal = (int)pow((float)halfWidth * 2 + 1, 2);
 	}
-	if(diameter == halfWidth == 1) goal = 1;
+	if(diameter == halfWidth) goal = 1;
 
+	stencil.xOffsets.resize(goal + 1);
+	stencil.yOffsets.resize(goal + 1);
+	stencil.minX = stencil.maxX = stencil.minY = stencil.maxY = 0;
 	for(int i = 0; i <= goal; i++)
 	{
-
-		n.push_back(getPixel(thisLevel, x + xOffset, y + yOffset));
+		stencil.xOffsets[i] = xOffset;
+		stencil.yOffsets[i] = yOffset;
+		stencil.minX = MIN(stencil.minX, xOffset);
+		stencil.maxX = MAX(stencil.maxX, xOffset);
+		stencil.minY = MIN(stencil.minY, yOffset);
+		stencil.maxY = MAX(stencil.maxY, yOffset);
 
 		xOffset--;
 		if(xOffset < -halfWidth)
@@ -83,18 +60,199 @@ void hood::addLevel(gauss_pyramid *p, int curL, int diameter, int x, int y, bool
 	}
 }
 
+hood_settings::hood_settings(int d, bool m, float red, float green, float blue)
+{
+	diameter = d;
+	multiresolution = m;
+
+	//the levels only get smaller until they're down to 1 color across
+	for(int l = 0; ; l++)
+	{
+		int levelD = levelDiameter(l);
+		causal.push_back(hood_stencil());
+		square.push_back(hood_stencil());
+		buildStencil(levelD, true, causal.back());
+		buildStencil(levelD, false, square.back());
+		if(levelD <= 1)
+			break;
+	}
+
+	//a weighted sum of squared differences w * (a - b)^2 is the same as (sqrt(w) * a - sqrt(w) * b)^2,
+	//so every channel just gets multiplied by the root of its weight ahead of time. everything is
+	//scaled down by the biggest weight so the heaviest channel keeps the whole 8 bit range.
+	float weights[HOOD_CHANNELS] = { red, green, blue };
+	float biggest = MAX(weights[0], MAX(weights[1], weights[2]));
+	for(int c = 0; c < HOOD_CHANNELS; c++)
+	{
+		float scale = (biggest > 0.0) ? sqrt(MAX(weights[c], 0.0f) / biggest) : 0.0;
+		for(int v = 0; v < 256; v++)
+			weightTable[c][v] = (Uint8) floor(v * scale + 0.5);
+	}
+}
+
+int hood_settings::levelDiameter(int l) const
+{
+	return (int) ceil(pow(0.5, l) * diameter);
+}
+
+hood::hood(const hood_settings *s, gauss_pyramid *p, int curL, int x, int y, bool d, bool wrap)
+{
+	colors = countColors(s, p, curL);
+	stride = strideOf(s, p, curL);
+	n = (Uint8*) alignedAlloc(stride, HOOD_ALIGN);
+	memset(n, 0, stride);
+	gather(s, p, curL, x, y, n, wrap);
+
+	if(d) dump(x, y, s->getDiameter());
+}
+
+int hood::countColors(const hood_settings *s, gauss_pyramid *p, int curL)
+{
+	//the shape of a neighborhood doesn't depend on where it is
+	return gather(s, p, curL, 0, 0, NULL);
+}
+
+bool hood::splitsCoarse(const hood_settings *s, gauss_pyramid *p, int curL)
+{
+	int own = s->getStencil(curL, true).xOffsets.size();
+	int coarse = countColors(s, p, curL) - own;
+	return coarse > 0 && strideFor(coarse) > HOOD_SPLIT_RATIO * strideFor(own);
+}
+
+int hood::coarseStart(const hood_settings *s, gauss_pyramid *p, int curL)
+{
+	int own = s->getStencil(curL, true).xOffsets.size();
+	return splitsCoarse(s, p, curL) ? strideFor(own) : own * HOOD_CHANNELS;
+}
+
+int hood::strideOf(const hood_settings *s, gauss_pyramid *p, int curL)
+{
+	int colors = countColors(s, p, curL);
+	if(!splitsCoarse(s, p, curL))
+		return strideFor(colors);
+	int own = s->getStencil(curL, true).xOffsets.size();
+	return strideFor(own) + strideFor(colors - own);
+}
+
+int hood::gather(const hood_settings *s, gauss_pyramid *p, int curL, int x, int y, Uint8 *out, bool wrap)
+{
+	//this level first, (x, y) is already on it
+	int colors = addLevel(s, p, curL, x, y, true, out, wrap);
+
+	//then all levels of the pyramid above this one, if the settings want them
+	if(!s->isMultiresolution())
+		return colors;
+	Uint8 *coarse = out ? out + coarseStart(s, p, curL) : NULL;
+	for(int l = p->getLevels() - 1; l > curL; l--)
+	{
+		int added = addLevel(s, p, l, levelPosition(curL, l, x), levelPosition(curL, l, y), false, coarse, wrap);
+		colors += added;
+		if(coarse)
+			coarse += added * HOOD_CHANNELS;
+	}
+
+	return colors;
+}
+
+int hood::gatherSquare(const hood_settings *s, gauss_pyramid *p, int curL, int x, int y, Uint8 *out)
+{
+	return addLevel(s, p, curL, x, y, false, out);
+}
+
+int hood::gatherRows(const hood_settings *s, const image_view<Uint32> &pixels, const SDL_PixelFormat *format, int curL, int x, int y, Uint8 *out, bool wrap)
+{
+	return addLevel(s, pixels, format, s->getStencil(curL, true), x, y, out, wrap);
+}
+
+void hood::offsets(const hood_settings *s, int curL, vector<int> &xOffsets, vector<int> &yOffsets)
+{
+	//the shape of the lowest level
+	const hood_stencil &stencil = s->getStencil(curL, true);
+	xOffsets = stencil.xOffsets;
+	yOffsets = stencil.yOffsets;
+}
+
+void hood::causalOffsets(const hood_settings *s, int curL, vector<int> &xOffsets, vector<int> &yOffsets)
+{
+	vector<int> xs, ys;
+	offsets(s, curL, xs, ys);
+	int count = xs.size();
+
+	//everything but the pixel itself
+	xOffsets.clear();
+	yOffsets.clear();
+	for(int i = 0; i < count; i++)
+	{
+		if(xs[i] == 0 && ys[i] == 0)
+			continue;
+		xOffsets.push_back(xs[i]);
+		yOffsets.push_back(ys[i]);
+	}
+}
+
+int hood::addLevel(const hood_settings *s, gauss_pyramid *p, int curL, int x, int y, bool lowest, Uint8 *out, bool wrap)
+{
+	const hood_stencil &stencil = s->getStencil(curL, lowest);
+	if(!out)
+		return addLevel(s, image_view<Uint32>(), NULL, stencil, x, y, NULL);
+	SDL_Surface *thisLevel = p->getLevel(curL);
+	return addLevel(s, surfaceView(thisLevel), thisLevel->format, stencil, x, y, out, wrap);
+}
+
+//unpacks and weighs pixel into the next HOOD_CHANNELS values of out
+static inline void addColor(const hood_settings *s, Uint32 pixel, const SDL_PixelFormat *format, Uint8 *out)
+{
+	Uint8 red, green, blue;
+	unpackRGB(pixel, format, &red, &green, &blue);
+	out[0] = s->weigh(0, red);
+	out[1] = s->weigh(1, green);
+	out[2] = s->weigh(2, blue);
+}
+
+//adds the count colors of a neighborhood that doesn't reach past any edge, so every
+//pixel can be read straight out of its row
+static inline void addInside(const hood_settings *s, const image_view<Uint32> &pixels, const SDL_PixelFormat *format, const int *xOffsets, const int *yOffsets, int count, int x, int y, Uint8 *out)
+{
+	for(int i = 0; i < count; i++, out += HOOD_CHANNELS)
+		addColor(s, pixels.at(x + xOffsets[i], y + yOffsets[i]), format, out);
+}
+
+int hood::addLevel(const hood_settings *s, const image_view<Uint32> &pixels, const SDL_PixelFormat *format, const hood_stencil &stencil, int x, int y, Uint8 *out, bool wrap)
+{
+	int count = stencil.xOffsets.size();
+	if(!out)
+		return count;
+	const int *xOffsets = &stencil.xOffsets[0], *yOffsets = &stencil.yOffsets[0];
+
+	//the colors are unpacked and weighted right away so nobody has to do it while comparing.
+	//most pixels are far enough from the edges that nothing has to be wrapped or clamped.
+	if(x + stencil.minX >= 0 && x + stencil.maxX < pixels.getWidth() && y + stencil.minY >= 0 && y + stencil.maxY < pixels.getHeight())
+	{
+		addInside(s, pixels, format, xOffsets, yOffsets, count, x, y, out);
+		return count;
+	}
+
+	for(int i = 0; i < count; i++, out += HOOD_CHANNELS)
+	{
+		int px = x + xOffsets[i], py = y + yOffsets[i];
+		addColor(s, wrap ? pixels.wrapped(px, py) : pixels.clamped(px, py), format, out);
+	}
+	return count;
+}
+
 
-void hood::dump(int ix, int iy)
+void hood::dump(int ix, int iy, int diameter)
 {
 	static int calls = 0;
 	if(calls > 400 || ix < 20 || iy < 20)
 		return;
 
-	SDL_Surface *dbg = createSurface(textonDiameter, 1);
+	SDL_Surface *dbg = createSurface(diameter, 1);
 	SDL_LockSurface(dbg);
-	for(int i = 0; i < textonDiameter; i++)
+	for(int i = 0; i < MIN(diameter, getColors()); i++)
 	{
-		putPixel(dbg, i, 0, n[i]);
+		const Uint8 *c = &n[i * HOOD_CHANNELS];
+		putPixel(dbg, i, 0, SDL_MapRGB(dbg->format, c[0], c[1], c[2]));
 	}
 	SDL_UnlockSurface(dbg);
 
@@ -105,69 +263,187 @@ void hood::dump(int ix, int iy)
 	calls++;
 }
 
-hood_pyramid::hood_pyramid(gauss_pyramid *p)
+hood_window::hood_window(const hood_settings *s, gauss_pyramid *p, int l, bool w)
+{
+	settings = s;
+	curL = l;
+	wrap = w;
+	stencil = &s->getStencil(l, true);
+	int count = stencil->xOffsets.size();
+
+	//the coarser levels come after this one, if there are any
+	stride = p ? hood::strideOf(s, p, l) : hood::strideFor(count);
+	coarseStart = p ? hood::coarseStart(s, p, l) : stride;
+	channels = (Uint8*) alignedAlloc(stride, HOOD_ALIGN);
+	memset(channels, 0, stride);
+	reset();
+	if(p && s->isMultiresolution())
+	{
+		coarseX.assign(p->getLevels(), -1);
+		coarseY.assign(p->getLevels(), -1);
+	}
+
+	//one step to the right, the color at offset (dx, dy) is the one that was at (dx + 1, dy)
+	shifted.assign(count, -1);
+	for(int i = 0; i < count; i++)
+	{
+		int dx = stencil->xOffsets[i] + 1, dy = stencil->yOffsets[i];
+		//that was the pixel itself, which has been synthesized since
+		if(dx == 0 && dy == 0)
+			continue;
+		for(int j = 0; j < count; j++)
+			if(stencil->xOffsets[j] == dx && stencil->yOffsets[j] == dy)
+				shifted[i] = j;
+	}
+
+	//color i takes over color shifted[i], which is to its right, so going from left to right
+	//every color is moved before its spot is written over
+	order.resize(count);
+	for(int i = 0; i < count; i++)
+		order[i] = i;
+	for(int i = 1; i < count; i++)
+		for(int j = i; j > 0 && stencil->xOffsets[order[j]] < stencil->xOffsets[order[j - 1]]; j--)
+			swap(order[j], order[j - 1]);
+}
+
+const Uint8 *hood_window::move(gauss_pyramid *p, int x, int y)
+{
+	//the coarser levels come after this one. they don't change while this one is synthesized,
+	//so a level only has to be gathered again when (x, y) lands on another one of its pixels.
+	Uint8 *out = channels + coarseStart;
+	for(int l = (int)coarseX.size() - 1; l > curL; l--)
+	{
+		int lx = hood::levelPosition(curL, l, x), ly = hood::levelPosition(curL, l, y);
+		const hood_stencil &coarse = settings->getStencil(l, false);
+		if(lx != coarseX[l] || ly != coarseY[l])
+		{
+			hood::addLevel(settings, p, l, lx, ly, false, out, wrap);
+			coarseX[l] = lx;
+			coarseY[l] = ly;
+		}
+		out += coarse.xOffsets.size() * HOOD_CHANNELS;
+	}
+	SDL_Surface *level = p->getLevel(curL);
+	moveLowest(surfaceView(level), level->format, x, y, channels);
+	return channels;
+}
+
+const Uint8 *hood_window::move(const image_view<Uint32> &pixels, const image_view<Uint32> *coarser, const SDL_PixelFormat *format, int x, int y)
+{
+	//the same as move(p, x, y), only the levels are already views
+	Uint8 *out = channels + coarseStart;
+	for(int l = (int)coarseX.size() - 1; l > curL; l--)
+	{
+		int lx = hood::levelPosition(curL, l, x), ly = hood::levelPosition(curL, l, y);
+		const hood_stencil &coarse = settings->getStencil(l, false);
+		if(lx != coarseX[l] || ly != coarseY[l])
+		{
+			hood::addLevel(settings, coarser[l], format, coarse, lx, ly, out, wrap);
+			coarseX[l] = lx;
+			coarseY[l] = ly;
+		}
+		out += coarse.xOffsets.size() * HOOD_CHANNELS;
+	}
+	moveLowest(pixels, format, x, y, channels);
+	return channels;
+}
+
+void hood_window::moveLowest(const image_view<Uint32> &pixels, const SDL_PixelFormat *format, int x, int y, Uint8 *out)
+{
+	//only shift if nothing wraps or is clamped, then every color is a different pixel and
+	//the one to the left of (x, y) is the only one that can have changed
+	bool inside = x + stencil->minX >= 0 && x + stencil->maxX < pixels.getWidth() && y + stencil->minY >= 0 && y + stencil->maxY < pixels.getHeight();
+	bool slide = inside && y == lastY && x == lastX + 1;
+	lastX = x;
+	lastY = y;
+	if(!slide)
+	{
+		hood::addLevel(settings, pixels, format, *stencil, x, y, out, wrap);
+		return;
+	}
+
+	for(int k = 0; k < order.size(); k++)
+	{
+		int i = order[k], from = shifted[i];
+		Uint8 *color = out + i * HOOD_CHANNELS;
+		if(from >= 0)
+		{
+			const Uint8 *was = out + from * HOOD_CHANNELS;
+			color[0] = was[0];
+			color[1] = was[1];
+			color[2] = was[2];
+		}
+		else
+			addColor(settings, pixels.at(x + stencil->xOffsets[i], y + stencil->yOffsets[i]), format, color);
+	}
+}
+
+hood_pyramid::hood_pyramid(const hood_settings *s, gauss_pyramid *p, bool square)
 {
 	//init values
 	parent = p;
+	settings = s;
+	owned = true;
 	int t = p->getLevels();
+	levels.resize(t);
 
 	//build hoods
 	verboseDebug("\tAllocating and building neighborhoods\n");
-	//allocate  (height) 2d arrays
-	hoods = new hood***[t];
 	//for each level
 	for(int i = t - 1; i >= 0; i--)
 	{
-		//get the level
-		SDL_Surface *thisLevel = p->getLevel(i);
-		int lvlW = thisLevel->w, lvlH = thisLevel->h;
+		setLevel(i, square);
+		hood_level &lvl = levels[i];
 
-		//allocate a 1d array of arrays of pointers (x)
-		hoods[i] = new hood**[lvlW];
-		//for each x
-		for(int j=0; j<lvlW; j++)
-		{
-			//allocate an array of pointers (y)
-			hoods[i][j] = new hood*[lvlH];
-			//for each y, allocate and generate the neighborhood
-			for(int k=0; k <lvlH; k++)
-				hoods[i][j][k] = new hood(p, i, j, k);
-		}
+		//one block for the whole level. zero it so the padding doesn't affect comparisons
+		size_t size = (size_t)lvl.w * lvl.h * lvl.stride;
+		Uint8 *data = (Uint8*) alignedAlloc(size, HOOD_ALIGN);
+		memset(data, 0, size);
+		lvl.data = data;
+		verboseDebug("\t\tlevel %d: %d x %d neighborhoods of %d colors (%lu bytes)\n", i, lvl.w, lvl.h, lvl.colors, (unsigned long) size);
+
+		//generate the neighborhoods in scanline order
+		for(int y = 0; y < lvl.h; y++)
+			for(int x = 0; x < lvl.w; x++)
+			{
+				Uint8 *out = data + ((size_t)y * lvl.w + x) * lvl.stride;
+				if(square)
+					hood::gatherSquare(s, p, i, x, y, out);
+				else
+					hood::gather(s, p, i, x, y, out);
+			}
 	}
 }
 
-hood_pyramid::~hood_pyramid()
+hood_pyramid::hood_pyramid(const hood_settings *s, gauss_pyramid *p, const vector<const Uint8*> &data, bool square)
 {
-	//clean up the neighborhoods
-	if(hoods)
+	parent = p;
+	settings = s;
+	owned = false;
+	levels.resize(p->getLevels());
+	for(int i = 0; i < levels.size(); i++)
 	{
-		int t = parent->getLevels();
+		setLevel(i, square);
+		levels[i].data = data[i];
+	}
+}
 
-		//for each level
-		for(int i=0; i<t; i++)
-		{
-			//get the level
-			SDL_Surface *thisLevel = parent->getLevel(i);
-			int lvlW = thisLevel->w, lvlH = thisLevel->h;
+void hood_pyramid::setLevel(int i, bool square)
+{
+	SDL_Surface *thisLevel = parent->getLevel(i);
+	hood_level &lvl = levels[i];
+	lvl.w = thisLevel->w;
+	lvl.h = thisLevel->h;
 
-			//for all the x values
-			for(int j=0; j<lvlW; j++)
-			{
-				//for all the y values
-				for(int k=0; k<lvlH; k++)
-				{
-					//delete this neighborhood
-					delete hoods[i][j][k];
-				}
-
-				//delete this column of neighborhoods
-				delete hoods[i][j];
-			}
+	//every neighborhood on a level has the same number of colors, pad that out
+	//so that each one starts on an aligned address
+	lvl.colors = square ? hood::gatherSquare(settings, parent, i, 0, 0, NULL) : hood::countColors(settings, parent, i);
+	lvl.stride = square ? hood::strideFor(lvl.colors) : hood::strideOf(settings, parent, i);
+}
 
-			//delete this row of neighborhoods
-			delete hoods[i];
-		}
-		//delete this array of 2d arrays
-		delete hoods;
-	}
+hood_pyramid::~hood_pyramid()
+{
+	//clean up the neighborhoods
+	for(int i = 0; owned && i < levels.size(); i++)
+		alignedFree((void*)levels[i].data);
 }
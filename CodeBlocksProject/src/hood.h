@@ -27,82 +27,359 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <vector>
-#include "util.h"	//debug() textonDiameter
+#include "util.h"	//debug()
 #ifdef __APPLE__
     #include <SDL/SDL.h>
 #else
     #include <SDL.h>
 #endif
-#include "sdl.h"		//getPixel()
+#include "sdl.h"		//surfaceView()
 #include "gauss_pyramid.h" //gauss pyramid class
+#include "ssd.h"		//SSD_ALIGN
 
 using namespace std;
 
+//how many channels are stored for every color of a neighborhood (red, green, blue)
+#define HOOD_CHANNELS 3
+//the byte alignment of the start of every neighborhood. they are also zero padded out to a
+//multiple of this so the ssd kernels can work on them in whole chunks
+#define HOOD_ALIGN SSD_ALIGN
+//the colors of the coarser levels only get their own aligned part of a neighborhood if they
+//take up more than this many times the bytes of the level's own (see hood::splitsCoarse())
+#define HOOD_SPLIT_RATIO 2
+
+//the shape of the neighborhoods on one level, worked out once by hood_settings: the offset
+//from the pixel of every color, in the order they're stored
+struct hood_stencil
+{
+	vector<int> xOffsets, yOffsets;
+	//how far the offsets reach, a pixel at least this far from every edge never needs
+	//its neighbors wrapped or clamped
+	int minX, maxX, minY, maxY;
+};
+
+//what every neighborhood of a synthesis is built with: how many colors it samples (the texton
+//neighborhood diameter), whether it samples the coarser levels too and how much each channel
+//counts. the input's and the output's neighborhoods have to be built with the same settings
+//to be compared.
+class hood_settings
+{
+	public:
+		//if multiresolution is true, a neighborhood takes colors from every level above its own
+		//as well (see hood::gather()). the weights say how much the differences in each channel
+		//count when neighborhoods are compared. they are folded into the unpacked channels when
+		//the neighborhoods are built.
+		hood_settings(int diameter, bool multiresolution, float red = 1.0, float green = 1.0, float blue = 1.0);
+
+		inline int getDiameter() const
+		{
+			return diameter;
+		}
+
+		inline bool isMultiresolution() const
+		{
+			return multiresolution;
+		}
+
+		//returns the diameter the neighborhoods use on level l
+		int levelDiameter(int l) const;
+
+		//returns the shape of the neighborhoods on level l. if lowest is true it's the shape
+		//of the level being synthesized, otherwise the whole square around the pixel.
+		inline const hood_stencil &getStencil(int l, bool lowest) const
+		{
+			const vector<hood_stencil> &shapes = lowest ? causal : square;
+			return shapes[MIN(l, (int)shapes.size() - 1)];
+		}
+
+		//returns the weighted value a neighborhood stores for value in channel
+		inline Uint8 weigh(int channel, Uint8 value) const
+		{
+			return weightTable[channel][value];
+		}
+
+	private:
+		int diameter;
+		bool multiresolution;
+
+		//the shapes of every level until the diameter gets down to 1, after that they're all
+		//the same as the last one
+		vector<hood_stencil> causal, square;
+
+		//maps each 8 bit channel value to its weighted value
+		Uint8 weightTable[HOOD_CHANNELS][256];
+};
+
 class hood
 {
 	public:
-		hood(gauss_pyramid *p, int curL, int x, int y, bool dump = false);
+		//if wrap is false, pixels past the edges of p are clamped to the edges instead of
+		//wrapping around to the other side
+		hood(const hood_settings *s, gauss_pyramid *p, int curL, int x, int y, bool dump = false, bool wrap = true);
 		~hood()
 		{
-		    SDL_FreeSurface(formatSurface);
+			alignedFree(n);
 		}
 
-		inline Uint32 getColor(int i)
+		//returns a pointer to the unpacked channels of this neighborhood.
+		//there are HOOD_CHANNELS of them per color, laid out the way gather() puts them.
+		//everything else up to getStride() is zeros.
+		inline const Uint8 *getChannels()
 		{
-			return n[i];
+			return n;
 		}
-		inline SDL_Surface *getFormatSurface()
+		inline int getColors()
 		{
-			return formatSurface;
+			return colors;
 		}
-		inline int getColors()
+		inline int getStride()
+		{
+			return stride;
+		}
+
+		//returns how many bytes a neighborhood of colors colors takes up once it is padded
+		static inline int strideFor(int colors)
 		{
-			return n.size();
+			return (colors * HOOD_CHANNELS + HOOD_ALIGN - 1) / HOOD_ALIGN * HOOD_ALIGN;
 		}
 
+		//returns where x on level curL is on the coarser level l. every level is half the size
+		//of the one below it. everything that reads the coarser levels of a neighborhood uses this.
+		static inline int levelPosition(int curL, int l, int x)
+		{
+			return x >> (l - curL);
+		}
+
+		//all of these build neighborhoods with the settings s
+
+		//fills in the offsets of all the pixels in the neighborhood of a pixel on level curL
+		//(including the pixel itself) in the order they're stored
+		static void offsets(const hood_settings *s, int curL, vector<int> &xOffsets, vector<int> &yOffsets);
+
+		//fills in the offsets of the pixels before a pixel on level curL that are in its neighborhood.
+		//these are the neighbors that are already synthesized when it is, in the order they're stored.
+		static void causalOffsets(const hood_settings *s, int curL, vector<int> &xOffsets, vector<int> &yOffsets);
+
+		//returns how many colors the neighborhood of any pixel on level curL of p has
+		static int countColors(const hood_settings *s, gauss_pyramid *p, int curL);
+
+		//returns true if the colors of the coarser levels start on the next multiple of HOOD_ALIGN
+		//after the ones of level curL in a neighborhood of that level, so the two parts can be
+		//compared on their own. the padding in between makes every comparison longer, so that's
+		//only done if there are enough coarse colors to make up for it (see HOOD_SPLIT_RATIO).
+		//without hood_settings::isMultiresolution() there aren't any.
+		static bool splitsCoarse(const hood_settings *s, gauss_pyramid *p, int curL);
+
+		//returns where the colors of the coarser levels start in a neighborhood of level curL, in bytes
+		static int coarseStart(const hood_settings *s, gauss_pyramid *p, int curL);
+
+		//returns how many bytes a neighborhood of level curL of p takes up once it is padded
+		static int strideOf(const hood_settings *s, gauss_pyramid *p, int curL);
+
+		//builds the neighborhood of (x, y) on level curL of p and unpacks it into out: the colors
+		//of level curL around (x, y) and then, starting at coarseStart(), the ones of the coarser
+		//levels around where (x, y) is on them (see levelPosition()).
+		//out must have room for strideOf(p, curL) bytes and the gap has to be zeros, or out can
+		//be NULL to just count. returns how many colors it has. if wrap is false, pixels past the
+		//edges are clamped to the edges instead of wrapping around to the other side.
+		static int gather(const hood_settings *s, gauss_pyramid *p, int curL, int x, int y, Uint8 *out, bool wrap = true);
+
+		//like gather() but only takes the whole square around (x, y) on level curL, the shape
+		//used for the levels above the one being synthesized. none of it has to be synthesized
+		//before (x, y) is, so this is what the parallel synthesis compares.
+		static int gatherSquare(const hood_settings *s, gauss_pyramid *p, int curL, int x, int y, Uint8 *out);
+
+		//builds the neighborhood of (x, y) with the shape gather() uses on level curL, but
+		//out of pixels (in format) instead of a pyramid level. pixels can be a view of just
+		//the rows the neighborhood needs, like the band of rows the streaming synthesis keeps.
+		static int gatherRows(const hood_settings *s, const image_view<Uint32> &pixels, const SDL_PixelFormat *format, int curL, int x, int y, Uint8 *out, bool wrap = true);
+
 	private:
+		friend class hood_window;
+
 		//dumps this hood to a file in the debug folder
-		void dump(int ix, int iy);
+		void dump(int ix, int iy, int diameter);
+
+		//adds the colors of pixels in the shape of stencil around (x, y) to out (if it isn't NULL)
+		//and returns how many colors it has. pixels and format are only used if out isn't NULL.
+		//wrap is the same as for gather().
+		static int addLevel(const hood_settings *s, const image_view<Uint32> &pixels, const SDL_PixelFormat *format, const hood_stencil &stencil, int x, int y, Uint8 *out, bool wrap = true);
+
+		//adds level curL of p the same way, in the shape of that level. p is only used if out isn't NULL.
+		static int addLevel(const hood_settings *s, gauss_pyramid *p, int curL, int x, int y, bool lowest, Uint8 *out, bool wrap = true);
 
-		//adds a neighborhood
-		void addLevel(gauss_pyramid *p, int curL, int diameter, int x, int y, bool lowest);
+		//no copying, the channels are ours to free
+		hood(const hood &);
+		hood &operator=(const hood &);
 
-		SDL_Surface *formatSurface;
-		vector<Uint32> n;
-		Uint32 color;
-};
+		Uint8 *n;
+		int colors, stride;
+};
 
+//the output neighborhoods of one pixel after another, the way the scanline order and the streaming
+//synthesis go through them. the neighborhood is kept from one pixel to the next: when the next
+//pixel is the one to the right of the last one, everything the two share is shifted over and
+//only the new colors (and the pixel that was just synthesized) are read. nothing is allocated
+//for a pixel.
+class hood_window
+{
+	public:
+		//for neighborhoods of level curL of p built with s. only how many levels p has matters
+		//here. if p is NULL they're only the lowest level, like hood::gatherRows() makes.
+		//wrap is the same as for hood::gather().
+		hood_window(const hood_settings *s, gauss_pyramid *p, int curL, bool wrap = true);
+		~hood_window()
+		{
+			alignedFree(channels);
+		}
+
+		//returns the neighborhood of (x, y) on level curL of p, byte for byte the same as
+		//hood::gather() makes it and padded out to getStride() bytes. it's good until the next
+		//call. between two calls only the pixel the last one was for can change, otherwise call
+		//reset() first.
+		const Uint8 *move(gauss_pyramid *p, int x, int y);
+
+		//the same out of pixels (level curL) and views of the coarser levels (in format), like
+		//the rows of every level the stream keeps. coarser[l] is level l for every l above
+		//curL, without coarser levels it's only read like hood::gatherRows() does. like with move(p, x, y), a coarser level is only gathered again
+		//when (x, y) lands on another one of its pixels, so the rows it reads there can't
+		//change after they're read.
+		const Uint8 *move(const image_view<Uint32> &pixels, const image_view<Uint32> *coarser, const SDL_PixelFormat *format, int x, int y);
+
+		//makes the next move() gather everything again, the coarser levels too
+		inline void reset()
+		{
+			lastX = lastY = -1;
+			coarseX.assign(coarseX.size(), -1);
+			coarseY.assign(coarseY.size(), -1);
+		}
+
+		inline int getStride()
+		{
+			return stride;
+		}
+
+	private:
+		//puts the lowest level of the neighborhood of (x, y) in out
+		void moveLowest(const image_view<Uint32> &pixels, const SDL_PixelFormat *format, int x, int y, Uint8 *out);
+
+		//no copying, the channels are ours to free
+		hood_window(const hood_window &);
+		hood_window &operator=(const hood_window &);
+
+		const hood_settings *settings;
+		const hood_stencil *stencil;
+		int curL;
+		bool wrap;
+
+		//the colors of the stencil from left to right, so shifting them over never writes over
+		//one that is still needed
+		vector<int> order;
+		//for every color of the stencil, the one that was the same pixel one step to the left,
+		//or -1 if it has to be read (it's new or it's the pixel that was just synthesized)
+		vector<int> shifted;
+
+		//the neighborhood of (lastX, lastY), the coarser levels start coarseStart bytes in
+		Uint8 *channels;
+		int stride, coarseStart, lastX, lastY;
+		//where on every coarser level the neighborhood was last gathered, empty if it doesn't
+		//have any coarser levels
+		vector<int> coarseX, coarseY;
+};
+
+//holds the neighborhoods of every pixel of a gaussian pyramid. every level keeps all of its
+//neighborhoods in one contiguous block of unpacked channels, one neighborhood after the other
+//in scanline order and each of them getStride(level) bytes long.
 class hood_pyramid
 {
 	public:
-		hood_pyramid(gauss_pyramid *pyramid);
+		//builds the neighborhoods with the settings s, which have to stay around as long as this does.
+		//if square is true, the neighborhoods are the ones from hood::gatherSquare()
+		hood_pyramid(const hood_settings *s, gauss_pyramid *pyramid, bool square = false);
+
+		//uses neighborhoods that were already built somewhere else (like a mapped analysis
+		//cache) instead of building them. data[i] has to be laid out like getLevelData(i)
+		//would be and stay around for as long as this does, it isn't copied or freed.
+		hood_pyramid(const hood_settings *s, gauss_pyramid *pyramid, const vector<const Uint8*> &data, bool square = false);
 		~hood_pyramid();
 
-		inline hood *getHood(int i, int x, int y)
+		//returns the unpacked channels of the neighborhood of (x, y) on level i.
+		//values past getColors(i) * HOOD_CHANNELS are padding and always zero.
+		inline const Uint8 *getHood(int i, int x, int y)
 		{
-			if(i < 0 || i >= parent->getLevels())
+			if(i < 0 || i >= levels.size())
 			{
 				debug("HOOD PYRAMID WARNING: hood request level index out of bounds: lvl %d\n", i);
-				i = parent->getLevels() - 1;
+				i = levels.size() - 1;
 			}
-			int w = parent->getLevel(i)->w;
-			int h = parent->getLevel(i)->h;
+			hood_level &lvl = levels[i];
 
-			if( x < 0 || y < 0 || x >= w || y >= h )
+			if( x < 0 || y < 0 || x >= lvl.w || y >= lvl.h )
 			{
 				debug("HOOD PYRAMID WARNING: hood request out of bounds: lvl %d at (%d, %d)\n", i, x, y);
 				return NULL;
 			}
 
+			return lvl.data + ((size_t)y * lvl.w + x) * lvl.stride;
+		}
 
-			return hoods[i][x][y];
+		//returns how many colors each neighborhood on level i has
+		inline int getColors(int i)
+		{
+			return levels[i].colors;
+		}
+
+		//returns how many bytes apart neighborhoods on level i are
+		inline int getStride(int i)
+		{
+			return levels[i].stride;
+		}
+
+		//returns the size of level i
+		inline int getWidth(int i)
+		{
+			return levels[i].w;
+		}
+		inline int getHeight(int i)
+		{
+			return levels[i].h;
+		}
+
+		//returns the first neighborhood of level i. the one for (x, y) is
+		//(y * getWidth(i) + x) * getStride(i) bytes after it.
+		inline const Uint8 *getLevelData(int i)
+		{
+			return levels[i].data;
+		}
+
+		//returns how many levels there are
+		inline int getLevels()
+		{
+			return levels.size();
+		}
+
+		//returns the settings the neighborhoods were built with
+		inline const hood_settings *getSettings()
+		{
+			return settings;
 		}
 
 	private:
-		//3d array of pointers :-S
-		hood ****hoods;
+		struct hood_level
+		{
+			const Uint8 *data;
+			int w, h, colors, stride;
+		};
+		vector<hood_level> levels;
+
+		//sets up the size, colors and stride of level i
+		void setLevel(int i, bool square);
+
+		//false if the data belongs to someone else
+		bool owned;
 
 		gauss_pyramid *parent;
-};
-
+		const hood_settings *settings;
+};
+
 #endif // HOOD_H_INCLUDED
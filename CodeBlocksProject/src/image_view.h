@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#ifndef IMAGE_VIEW_H_INCLUDED
+#define IMAGE_VIEW_H_INCLUDED
+
+/*
+ * This file contains a small view over the raw pixels of an image. It doesn't own the
+ * pixels or lock anything, it just knows where the rows are, so reading a pixel is an
+ * index instead of a function call. The synthesis only makes software surfaces (see
+ * createSurface()) and those never need locking, so SDL is only needed to load, save and
+ * show the images.
+ */
+
+#ifdef __APPLE__
+    #include <SDL/SDL.h>
+#else
+    #include <SDL.h>
+#endif
+#include <stdlib.h>
+
+//v wrapped into [0, size). coordinates are rarely more than one image off the edge, so
+//that's done with selects instead of a division; only tiny levels need the modulo.
+inline int wrapCoordinate(int v, int size)
+{
+	v += (v < 0) ? size : 0;
+	v -= (v >= size) ? size : 0;
+	if((unsigned)v >= (unsigned)size)
+		v = (v % size + size) % size;
+	return v;
+}
+
+//v moved into [0, size) by going to the closest edge
+inline int clampCoordinate(int v, int size)
+{
+	v = (v < 0) ? 0 : v;
+	return (v >= size) ? size - 1 : v;
+}
+
+template <typename T>
+class image_view
+{
+public:
+	image_view()
+	{
+		pixels = NULL;
+		rows = NULL;
+		w = h = stride = 0;
+	}
+
+	//a view of width x height pixels, the rows of which start stride pixels apart
+	image_view(T *data, int width, int height, int rowStride)
+	{
+		pixels = data;
+		rows = NULL;
+		w = width;
+		h = height;
+		stride = rowStride;
+	}
+
+	//a view of width x height pixels where row y starts at rowTable[y]. the rows can be
+	//anywhere, so only the ones that are used have to be in memory (see tex_syn_context::stream()).
+	//the table isn't copied, changing it moves the rows of the view.
+	image_view(T *const *rowTable, int width, int height)
+	{
+		pixels = NULL;
+		rows = rowTable;
+		w = width;
+		h = height;
+		stride = 0;
+	}
+
+	inline int getWidth() const
+	{
+		return w;
+	}
+
+	inline int getHeight() const
+	{
+		return h;
+	}
+
+	inline T *row(int y) const
+	{
+		return rows ? rows[y] : pixels + (size_t)y * stride;
+	}
+
+	//pixel (x, y), which has to be inside the image
+	inline T &at(int x, int y) const
+	{
+		return row(y)[x];
+	}
+
+	//pixel (x, y) wrapped around the edges, so the image tiles
+	inline T &wrapped(int x, int y) const
+	{
+		return at(wrapCoordinate(x, w), wrapCoordinate(y, h));
+	}
+
+	//pixel (x, y), moved onto the closest edge pixel if it's outside
+	inline T &clamped(int x, int y) const
+	{
+		return at(clampCoordinate(x, w), clampCoordinate(y, h));
+	}
+
+private:
+	T *pixels;
+	T *const *rows;
+	int w, h, stride;
+};
+
+//a view of the pixels of a 32 bit software surface. it's good for as long as the surface is.
+inline image_view<Uint32> surfaceView(SDL_Surface *surface)
+{
+	return image_view<Uint32>((Uint32*)surface->pixels, surface->w, surface->h, surface->pitch / 4);
+}
+
+//the 8 bit red, green and blue of a pixel of a 32 bit surface with the given format,
+//the same as SDL_GetRGB() but without the function call
+inline void unpackRGB(Uint32 pixel, const SDL_PixelFormat *format, Uint8 *r, Uint8 *g, Uint8 *b)
+{
+	*r = (Uint8)((pixel & format->Rmask) >> format->Rshift);
+	*g = (Uint8)((pixel & format->Gmask) >> format->Gshift);
+	*b = (Uint8)((pixel & format->Bmask) >> format->Bshift);
+}
+
+//the other way around, the same as SDL_MapRGB() for a 32 bit surface with the given format
+inline Uint32 packRGB(Uint8 r, Uint8 g, Uint8 b, const SDL_PixelFormat *format)
+{
+	return ((Uint32)r << format->Rshift) | ((Uint32)g << format->Gshift) | ((Uint32)b << format->Bshift) | format->Amask;
+}
+
+#endif // IMAGE_VIEW_H_INCLUDED
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "kcoherence.h"
+#include <string.h>	//memcmp()
+
+similarity_sets::similarity_sets(hood_pyramid *h, int numSimilar)
+{
+	hoods = h;
+	k = MAX(numSimilar, 1);
+	buildLevel = 0;
+
+	sets.resize(hoods->getLevels());
+	levelSets.resize(hoods->getLevels());
+	for(int l = 0; l < hoods->getLevels(); l++)
+	{
+		sets[l].assign((size_t)hoods->getWidth(l) * hoods->getHeight(l) * k, -1);
+		levelSets[l] = &sets[l][0];
+	}
+}
+
+similarity_sets::similarity_sets(hood_pyramid *h, int numSimilar, const vector<const int*> &data)
+{
+	hoods = h;
+	k = MAX(numSimilar, 1);
+	buildLevel = 0;
+	levelSets = data;
+}
+
+similarity_sets::~similarity_sets()
+{
+}
+
+void similarity_sets::build(worker_pool *pool)
+{
+	for(buildLevel = 0; buildLevel < hoods->getLevels(); buildLevel++)
+	{
+		verboseDebug("\tFinding the %d most similar neighborhoods on level %d\n", k, buildLevel);
+		pool->run(buildRow, (void*)this, hoods->getHeight(buildLevel));
+	}
+	verboseDebug("done.\n");
+}
+
+void similarity_sets::buildRow(int y, void *data)
+{
+	similarity_sets *s = (similarity_sets*) data;
+	int l = s->buildLevel, k = s->k;
+	int w = s->hoods->getWidth(l), count = w * s->hoods->getHeight(l);
+	int stride = s->hoods->getStride(l);
+	ssd_bounded_func compare = fixedBoundedSSD(stride);
+	const Uint8 *levelData = s->hoods->getLevelData(l);
+
+	//the best k so far, kept sorted with the best first
+	vector<Uint64> bestDist(k);
+	vector<int> best(k);
+
+	for(int x = 0; x < w; x++)
+	{
+		int i = y * w + x;
+		const Uint8 *thisHood = levelData + (size_t)i * stride;
+		int found = 0;
+
+		for(int j = 0; j < count; j++)
+		{
+			//a pixel is always the most similar to itself, that's no help
+			if(j == i)
+				continue;
+
+			//once there are k, anything farther than the last of them is no use
+			Uint64 d = compare(thisHood, levelData + (size_t)j * stride, stride, (found == k) ? bestDist[k - 1] : ~(Uint64)0);
+			//j only grows, so a tie never beats what is already there
+			if(found == k && d >= bestDist[k - 1])
+				continue;
+
+			//insert it in order
+			int at = MIN(found, k - 1);
+			while(at > 0 && bestDist[at - 1] > d)
+			{
+				bestDist[at] = bestDist[at - 1];
+				best[at] = best[at - 1];
+				at--;
+			}
+			bestDist[at] = d;
+			best[at] = j;
+			if(found < k)
+				found++;
+		}
+
+		int *set = &s->sets[l][(size_t)i * k];
+		for(int n = 0; n < k; n++)
+			set[n] = (n < found) ? best[n] : -1;
+	}
+}
+
+Uint64 similarity_sets::hoodHash()
+{
+	//FNV-1a over every neighborhood of every level
+	Uint64 hash = 14695981039346656037ULL;
+	for(int l = 0; l < hoods->getLevels(); l++)
+	{
+		size_t size = (size_t)hoods->getWidth(l) * hoods->getHeight(l) * hoods->getStride(l);
+		const Uint8 *data = hoods->getLevelData(l);
+		for(size_t i = 0; i < size; i++)
+		{
+			hash ^= data[i];
+			hash *= 1099511628211ULL;
+		}
+	}
+	return hash;
+}
+
+bool similarity_sets::save(const char *filename)
+{
+	FILE *file = fopen(filename, "wb");
+	if(!file)
+	{
+		debug("WARNING: couldn't open %s to save the similarity sets\n", filename);
+		return false;
+	}
+
+	//header: what the sets were made for
+	int version = KCOHERENCE_VERSION, levels = hoods->getLevels();
+	Uint64 hash = hoodHash();
+	bool ok = fwrite(KCOHERENCE_MAGIC, 1, 4, file) == 4;
+	ok = ok && fwrite(&version, sizeof(int), 1, file) == 1;
+	ok = ok && fwrite(&k, sizeof(int), 1, file) == 1;
+	ok = ok && fwrite(&levels, sizeof(int), 1, file) == 1;
+	ok = ok && fwrite(&hash, sizeof(Uint64), 1, file) == 1;
+
+	for(int l = 0; ok && l < levels; l++)
+	{
+		size_t count = (size_t)hoods->getWidth(l) * hoods->getHeight(l) * k;
+		ok = fwrite(levelSets[l], sizeof(int), count, file) == count;
+	}
+
+	fclose(file);
+	if(!ok)
+		debug("WARNING: couldn't write the similarity sets to %s\n", filename);
+	return ok;
+}
+
+bool similarity_sets::load(const char *filename)
+{
+	//sets from somewhere else can't be overwritten
+	FILE *file = sets.empty() ? NULL : fopen(filename, "rb");
+	if(!file)
+		return false;
+
+	char magic[4];
+	int version = 0, fileK = 0, levels = 0;
+	Uint64 hash = 0;
+	bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, KCOHERENCE_MAGIC, 4) == 0;
+	ok = ok && fread(&version, sizeof(int), 1, file) == 1 && version == KCOHERENCE_VERSION;
+	ok = ok && fread(&fileK, sizeof(int), 1, file) == 1 && fileK == k;
+	ok = ok && fread(&levels, sizeof(int), 1, file) == 1 && levels == hoods->getLevels();
+	ok = ok && fread(&hash, sizeof(Uint64), 1, file) == 1 && hash == hoodHash();
+
+	for(int l = 0; ok && l < levels; l++)
+		ok = fread(&sets[l][0], sizeof(int), sets[l].size(), file) == sets[l].size();
+
+	fclose(file);
+	if(!ok)
+		debug("Similarity sets in %s don't match this input, they will be rebuilt\n", filename);
+	return ok;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef KCOHERENCE_H_INCLUDED
+#define KCOHERENCE_H_INCLUDED
+
+/*
+ * This file contains the similarity sets used by the k-coherence search (Tong et al.).
+ * For every pixel of every input level they hold the k other pixels of that level with
+ * the most similar neighborhoods. They only depend on the input texture and the
+ * neighborhood settings, so they can be saved to a file and loaded the next time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "util.h"			//debug()
+#include "hood.h"			//hood_pyramid class
+#include "ssd.h"			//ssd()
+#include "worker_pool.h"	//worker_pool class
+
+using namespace std;
+
+//the first bytes of a similarity set file and the version of its layout
+#define KCOHERENCE_MAGIC "TSKC"
+#define KCOHERENCE_VERSION 1
+
+class similarity_sets
+{
+public:
+	//makes empty sets of k pixels for the neighborhoods in hoods. use build() or load() to fill them.
+	similarity_sets(hood_pyramid *hoods, int k);
+
+	//uses sets that were already found somewhere else (like a mapped analysis cache). data[l]
+	//has to be laid out like the sets of level l and stay around, it isn't copied.
+	similarity_sets(hood_pyramid *hoods, int k, const vector<const int*> &data);
+	~similarity_sets();
+
+	//finds the k most similar neighborhoods of every input pixel. every level is split
+	//up by rows between the threads of pool.
+	void build(worker_pool *pool);
+
+	//saves the sets to filename, returns false if it couldn't
+	bool save(const char *filename);
+
+	//loads sets that were saved for the exact same neighborhoods and k.
+	//returns false if the file can't be read or was made for something else.
+	bool load(const char *filename);
+
+	//returns the k pixel indices (y * width + x) most like pixel i on level l, best first
+	inline const int *getSet(int l, int i)
+	{
+		return levelSets[l] + (size_t)i * k;
+	}
+
+	inline int getK()
+	{
+		return k;
+	}
+
+private:
+	//the worker pool runs this for every row of the level being built
+	static void buildRow(int y, void *data);
+
+	//a hash of all the neighborhoods so a saved file can be checked against them
+	Uint64 hoodHash();
+
+	hood_pyramid *hoods;
+	int k;
+	//the sets that were built here, if they were
+	vector< vector<int> > sets;
+	//where the sets of every level are, in sets or somewhere else
+	vector<const int*> levelSets;
+
+	//the level build() is working on
+	int buildLevel;
+};
+
+#endif // KCOHERENCE_H_INCLUDED
@@ -18,6 +18,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>	//strcmp(), strchr()
 #include "util.h"
 
 #ifdef __APPLE__
@@ -27,81 +28,304 @@
     #include <SDL.h>
     #include <SDL_image.h>
 #endif
+#ifdef _MSC_VER
+	//older visual studios only have it with an underscore
+	#define snprintf _snprintf
+#endif
 
-//for initSDL(), checkEvents(), and the screen surface
+//for initSDL() and checkEvents()
 #include "sdl.h"
 #include "tex_syn.h"
+#include "preview.h"
+#include "server.h"
+#include "selftest.h"
 
 SDL_Surface *inputTexture;
+SDL_Surface *outputTexture;
 int outputSize;
+tex_syn_params params;
+
+//where to serve jobs from instead of synthesizing one texture, and how many megabytes of analyses to keep
+char *servePath = NULL;
+int serveMemory = SERVER_DEFAULT_MEMORY;
+
+//whether --seed was given, otherwise the seed is the time
+bool seeded = false;
+
+//whether to stream the output to a ppm a row at a time instead of keeping all of it
+bool streamOutput = false;
+
+//whether to run the self test on the input instead of saving a texture
+bool runSelfTest = false;
+
+//whether to run without a window, and how often the window is redrawn if there is one
+bool headless = false;
+int previewFps = PREVIEW_DEFAULT_FPS;
+
+//hands the level being synthesized to the preview_window in data
+void showProgress(SDL_Surface *level, void *data)
+{
+	((preview_window*)data)->publish(level);
+}
+
+//runs the texture synthesis, the preview_window starts this in its own thread
+int synthesize(void *data)
+{
+	outputTexture = textureSynthesis(inputTexture, outputSize, outputSize, params);
+	return 0;
+}
+
+//prints out how to use the program and quits
+void usage(char *name)
+{
+    fprintf(stderr, "Usage: %s (input texture filename) (texton neighborhood diameter) \n", name);
+    fprintf(stderr, "                (output size) [number threads] [r weight] [g weight] [b weight]\n");
+    fprintf(stderr, "                [--option=value ...]\n");
+    fprintf(stderr, "   Options in () are required, options in [] are optional.\n");
+	fprintf(stderr, "        Note that if you want to set r weight, number threads must be set too.\n");
+    fprintf(stderr, "   Input texture reading is handled by SDL_Image so the file can be tga, bmp, \n");
+    fprintf(stderr, "         pnm, xpm, xcf, pcx, gif, jpg, lbm, or png.\n");
+    fprintf(stderr, "   If [number threads] is set to 0, no threads will be generated. If it is set\n");
+    fprintf(stderr, "         to 1, one thread will be generated to help with the work. Default is %d.\n", params.threads);
+    fprintf(stderr, "   [rgb weight] defines how much weight to give to the r, g, and b channels\n");
+    fprintf(stderr, "         when calculating the similarity between two neighborhoods.\n");
+    fprintf(stderr, "         These values are only used if rgb weighting is enabled in the code.\n");
+    fprintf(stderr, "         Default Values are %f, %f, and %f respectively.\n", params.redWeight, params.greenWeight, params.blueWeight);
+    fprintf(stderr, "   --options can go anywhere on the command line:\n");
+    fprintf(stderr, "     --search=exhaustive|tsvq|coherence|kcoherence|patchmatch|fft|parallel\n");
+    fprintf(stderr, "         how to find the best matching neighborhood. Default is exhaustive.\n");
+    fprintf(stderr, "     --tsvq-depth=N   how deep the tsvq trees can get. Default is %d.\n", params.tsvqDepth);
+    fprintf(stderr, "     --tsvq-leaves=N  how many tsvq leaves to search. Default is %d.\n", params.tsvqLeaves);
+    fprintf(stderr, "     --k=N  how many similar pixels k-coherence and parallel try. Default is %d.\n", params.kcoherenceK);
+    fprintf(stderr, "     --kcoherence-cache=file  where to keep the k-coherence similarity sets.\n");
+    fprintf(stderr, "     --patchmatch-iterations=N  how many PatchMatch passes are made over every\n");
+    fprintf(stderr, "         level. Default is %d.\n", params.patchmatchIterations);
+    fprintf(stderr, "     --patchmatch-radius=N  how far from the current match the PatchMatch random\n");
+    fprintf(stderr, "         search starts looking, 0 for the whole input. Default is %d.\n", params.patchmatchRadius);
+    fprintf(stderr, "     --parallel-passes=N  how many correction passes the parallel synthesis\n");
+    fprintf(stderr, "         makes over every level. Default is %d.\n", params.parallelPasses);
+    fprintf(stderr, "     --parallel-jitter=N  how many pixels the parallel synthesis can move the\n");
+    fprintf(stderr, "         coordinates it gets from the coarser level. Default is %.1f.\n", params.parallelJitter);
+    fprintf(stderr, "     --coarse-terms=N  how many megabytes of the distances to the coarser levels\n");
+    fprintf(stderr, "         the exhaustive search keeps for the next pixels, 0 for none. It makes no\n");
+    fprintf(stderr, "         difference to the texture. Default is %d.\n", (int)(params.coarseTermsMemory >> 20));
+    fprintf(stderr, "     --order=scanline|wavefront  whether to synthesize one pixel at a time or\n");
+    fprintf(stderr, "         every pixel that doesn't depend on another at once. Default is scanline.\n");
+    fprintf(stderr, "     --edges=wrap|clamp  whether the output neighborhoods wrap around the edges\n");
+    fprintf(stderr, "         (so the texture tiles) or stop at them. Default is wrap.\n");
+    fprintf(stderr, "     --analysis-cache=dir  where to keep the analysis of input textures so later\n");
+    fprintf(stderr, "         runs with the same input and settings don't have to make it again.\n");
+    fprintf(stderr, "     --headless  don't open a window, just save the output texture.\n");
+    fprintf(stderr, "     --preview-fps=N  how many times a second the window is redrawn while\n");
+    fprintf(stderr, "         synthesizing. Default is %d.\n", PREVIEW_DEFAULT_FPS);
+    fprintf(stderr, "     --stream  write the output to a ppm a row at a time as it is made instead of\n");
+    fprintf(stderr, "         keeping all of it in memory, for huge outputs. Implies --headless and\n");
+    fprintf(stderr, "         doesn't work with patchmatch or parallel.\n");
+    fprintf(stderr, "     --self-test  synthesize textures from the input every way that should give\n");
+    fprintf(stderr, "         the same texture and check that they do (see selftest.h) instead of\n");
+    fprintf(stderr, "         saving one. Implies --headless. Exits with 1 if any of them don't.\n");
+    fprintf(stderr, "     --seed=N  where the random noise comes from, the same seed and settings\n");
+    fprintf(stderr, "         always make the same texture. Default is the time.\n");
+    fprintf(stderr, "     --threads=N  the same as [number threads], for --serve.\n");
+    fprintf(stderr, "     --serve=socket  don't synthesize anything yet, run jobs sent to the unix\n");
+    fprintf(stderr, "         socket instead (see server.h). The other arguments aren't needed.\n");
+    fprintf(stderr, "     --serve-memory=N  how many megabytes of exemplar analyses --serve keeps.\n");
+    fprintf(stderr, "         Default is %d.\n", SERVER_DEFAULT_MEMORY);
+    exit(EXIT_FAILURE);
+}
+
+//handles one --name=value or --switch option. returns false if it isn't a known option
+bool parseOption(char *option)
+{
+	char *value = strchr(option, '=');
+	if(!value)
+	{
+		if(strcmp(option, "--headless") == 0)
+		{
+			headless = true;
+			return true;
+		}
+		if(strcmp(option, "--stream") == 0)
+		{
+			streamOutput = headless = true;
+			return true;
+		}
+		if(strcmp(option, "--self-test") == 0)
+		{
+			runSelfTest = headless = true;
+			return true;
+		}
+		return false;
+	}
+	value++;
+
+	if(strncmp(option, "--search=", 9) == 0)
+	{
+		params.search = searchNamed(value);
+		if(params.search < 0)
+			return false;
+	}
+	else if(strncmp(option, "--tsvq-depth=", 13) == 0)
+		params.tsvqDepth = MAX(atoi(value), 1);
+	else if(strncmp(option, "--tsvq-leaves=", 14) == 0)
+		params.tsvqLeaves = MAX(atoi(value), 1);
+	else if(strncmp(option, "--k=", 4) == 0)
+		params.kcoherenceK = MAX(atoi(value), 0);
+	else if(strncmp(option, "--kcoherence-cache=", 19) == 0)
+		params.kcoherenceCache = value;
+	else if(strncmp(option, "--patchmatch-iterations=", 24) == 0)
+		params.patchmatchIterations = MAX(atoi(value), 1);
+	else if(strncmp(option, "--patchmatch-radius=", 20) == 0)
+		params.patchmatchRadius = MAX(atoi(value), 0);
+	else if(strncmp(option, "--order=", 8) == 0)
+	{
+		if(strcmp(value, "scanline") == 0)
+			params.order = TEX_SYN_ORDER_SCANLINE;
+		else if(strcmp(value, "wavefront") == 0)
+			params.order = TEX_SYN_ORDER_WAVEFRONT;
+		else
+			return false;
+	}
+	else if(strncmp(option, "--analysis-cache=", 17) == 0)
+		params.analysisCache = value;
+	else if(strncmp(option, "--seed=", 7) == 0)
+	{
+		params.seed = strtoul(value, NULL, 10);
+		seeded = true;
+	}
+	else if(strncmp(option, "--threads=", 10) == 0)
+		params.threads = MAX(atoi(value), 0);
+	else if(strncmp(option, "--serve=", 8) == 0)
+		servePath = value;
+	else if(strncmp(option, "--serve-memory=", 15) == 0)
+		serveMemory = MAX(atoi(value), 0);
+	else if(strncmp(option, "--preview-fps=", 14) == 0)
+		previewFps = MAX(atoi(value), 1);
+	else if(strncmp(option, "--edges=", 8) == 0)
+	{
+		if(strcmp(value, "wrap") == 0)
+			params.edges = TEX_SYN_EDGES_WRAP;
+		else if(strcmp(value, "clamp") == 0)
+			params.edges = TEX_SYN_EDGES_CLAMP;
+		else
+			return false;
+	}
+	else if(strncmp(option, "--parallel-passes=", 18) == 0)
+		params.parallelPasses = MAX(atoi(value), 0);
+	else if(strncmp(option, "--parallel-jitter=", 18) == 0)
+		params.parallelJitter = MAX(atof(value), 0.0);
+	else if(strncmp(option, "--coarse-terms=", 15) == 0)
+		params.coarseTermsMemory = (size_t)MAX(atoi(value), 0) << 20;
+	else
+		return false;
+
+	return true;
+}
 
 int main ( int argc, char** argv )
 {
-    //make sure we have all the necessary arguments
-    if( argc < 4 )
+    //pull the --options out, everything else is read by position below
+    int positional = 1;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strncmp(argv[i], "--", 2) == 0)
+        {
+            if(!parseOption(argv[i]))
+            {
+                fprintf(stderr, "Unknown option %s\n", argv[i]);
+                usage(argv[0]);
+            }
+        }
+        else
+            argv[positional++] = argv[i];
+    }
+    argc = positional;
+
+    //every synthesis from here on uses the same comparison kernel
+    debug("Using the %s neighborhood comparison kernel\n", initSSD());
+
+    //the server gets everything else from the jobs, and never opens a window
+    if(servePath)
     {
-        fprintf(stderr, "Usage: %s (input texture filename) (texton neighborhood diameter) \n", argv[0]);
-        fprintf(stderr, "                (output size) [number threads] [r weight] [g weight] [b weight]\n");
-        fprintf(stderr, "   Options in () are required, options in [] are optional.\n");
-		fprintf(stderr, "        Note that if you want to set r weight, number threads must be set too.\n");
-        fprintf(stderr, "   Input texture reading is handled by SDL_Image so the file can be tga, bmp, \n");
-        fprintf(stderr, "         pnm, xpm, xcf, pcx, gif, jpg, lbm, or png.\n");
-        fprintf(stderr, "   If [number threads] is set to 0, no threads will be generated. If it is set\n");
-        fprintf(stderr, "         to 1, one thread will be generated to do all the work. Default is %d.\n", TEX_SYN_THREADS);
-        fprintf(stderr, "   [rgb weight] defines how much weight to give to the r, g, and b channels\n");
-        fprintf(stderr, "         when calculating the similarity between two neighborhoods.\n");
-        fprintf(stderr, "         These values are only used if rgb weighting is enabled in the code.\n");
-        fprintf(stderr, "         Default Values are %f, %f, and %f respectively.\n", TEX_SYN_RED_WEIGHT, TEX_SYN_GREEN_WEIGHT, TEX_SYN_BLUE_WEIGHT);
-        exit(EXIT_FAILURE);
+        initSDL(0, 0, true);
+        tex_syn_server server(params, (size_t)serveMemory * 1024 * 1024);
+        return server.serve(servePath) ? 0 : 1;
     }
+
+    //make sure we have all the necessary arguments
+    if( argc < 4 )
+        usage(argv[0]);
     //looks good, start loading values:
 
     //diameter
-    textonDiameter = atoi(argv[2]);
-    //make sure textonDiameter is odd, add one to it if it is even.
-    if(textonDiameter % 2 == 0)
-        textonDiameter++;
+    params.diameter = atoi(argv[2]);
+    //make sure the diameter is odd, add one to it if it is even.
+    if(params.diameter % 2 == 0)
+        params.diameter++;
 
 	//output size
     outputSize = atoi(argv[3]);
 
     //# threads
     if(argc >= 5)
-    	TEX_SYN_THREADS = atoi(argv[4]);
+    	params.threads = atoi(argv[4]);
 
     //r weight
     if(argc >= 6)
-    	TEX_SYN_RED_WEIGHT = atof(argv[5]);
+    	params.redWeight = atof(argv[5]);
 
     //g weight
     if(argc >= 7)
-    	TEX_SYN_GREEN_WEIGHT = atof(argv[6]);
+    	params.greenWeight = atof(argv[6]);
 
     //b weight
     if(argc >= 8)
-    	TEX_SYN_BLUE_WEIGHT = atof(argv[7]);
+    	params.blueWeight = atof(argv[7]);
 
     debug("Will generate texture using file %s as a kernel and\n", argv[1]);
-    debug("\tneighborhood size %d to generate unique %d x %d texture\n", textonDiameter, outputSize, outputSize);
-#ifdef TEX_SYN_USE_MULTIRESOLUTION
-	debug("\twith a multi-resolution synthesis algorithm.\n");
-#else
-	debug("\twith a single-resolution synthesis algorithm.\n");
-#endif
-	if(TEX_SYN_THREADS == 0)
+    debug("\tneighborhood size %d to generate unique %d x %d texture\n", params.diameter, outputSize, outputSize);
+	if(params.multiresolution)
+		debug("\twith a multi-resolution synthesis algorithm.\n");
+	else
+		debug("\twith a single-resolution synthesis algorithm.\n");
+	if(params.threads == 0)
 		debug("No threads will be generated to compare neighborhoods.\n");
 	else
-		debug("%d threads will be generated to compare neighborhoods.\n", TEX_SYN_THREADS);
-#ifdef TEX_SYN_WEIGHTED_COLORS
-	debug("When comparing neighborhoods, red, green, and blue will be weighted\n");
-	debug("\twith the values %f, %f, and %f respectively\n", TEX_SYN_RED_WEIGHT, TEX_SYN_GREEN_WEIGHT, TEX_SYN_BLUE_WEIGHT);
-#else
-	debug("When comparing neighborhoods, red, green, and blue will not be weighted\n");
-#endif
+		debug("A pool of %d threads will be used to compare neighborhoods.\n", params.threads);
+	if(params.search == TEX_SYN_SEARCH_TSVQ)
+		debug("Neighborhoods will be found with TSVQ trees of depth %d searching %d leaves.\n", params.tsvqDepth, params.tsvqLeaves);
+	else if(params.search == TEX_SYN_SEARCH_COHERENCE)
+		debug("Neighborhoods will be found with a coherence search.\n");
+	else if(params.search == TEX_SYN_SEARCH_KCOHERENCE)
+		debug("Neighborhoods will be found with a k-coherence search with k = %d.\n", params.kcoherenceK);
+	else if(params.search == TEX_SYN_SEARCH_PATCHMATCH)
+		debug("Neighborhoods will be found with %d PatchMatch passes per level.\n", params.patchmatchIterations);
+	else if(params.search == TEX_SYN_SEARCH_FFT)
+		debug("Neighborhoods will be found with an fft search.\n");
+	else if(params.search == TEX_SYN_SEARCH_PARALLEL)
+		debug("Levels will be made with the parallel synthesis and %d correction passes.\n", params.parallelPasses);
+	else
+		debug("Neighborhoods will be found with an exhaustive search.\n");
+	if(params.weightedColors)
+	{
+		debug("When comparing neighborhoods, red, green, and blue will be weighted\n");
+		debug("\twith the values %f, %f, and %f respectively\n", params.redWeight, params.greenWeight, params.blueWeight);
+	}
+	else
+		debug("When comparing neighborhoods, red, green, and blue will not be weighted\n");
+
+	if(params.analysisCache)
+		debug("The analysis of the input will be kept in %s\n", params.analysisCache);
+	if(streamOutput)
+		debug("The output will be written a row at a time as it is synthesized.\n");
+	else if(headless)
+		debug("No window will be opened, the output will only be saved.\n");
+	else
+		debug("The preview will be redrawn up to %d times a second.\n", previewFps);
 
     //initialize SDL
     debug("Initializing SDL\n");
-    initSDL(outputSize, outputSize);
+    SDL_Surface *screen = initSDL(outputSize, outputSize, headless);
 
     // load an image
     debug("Loading Image %s\n", argv[1]);
@@ -114,40 +338,13 @@ int main ( int argc, char** argv )
 
     //convert to be the same format as the display (32 bit)
     debug("Convert input texture to useable format\n");
-    inputTexture = SDL_DisplayFormat(loadedTexture);
+    inputTexture = convertSurface(loadedTexture);
     SDL_FreeSurface(loadedTexture);
 
-    //run the texture synthesis
-	SDL_Surface *outputTexture = textureSynthesis(inputTexture, outputSize, outputSize);
-
-	//this is the texture that will be rendered on screen:
-	SDL_Surface *renderTexture = outputTexture;
-    // centre the bitmap on screen
-    SDL_Rect dstrect;
-    dstrect.x = (screen->w - renderTexture->w) / 2;
-    dstrect.y = (screen->h - renderTexture->h) / 2;
-
-    // program main loop
-    debug("Entering display loop...\n");
-    while (!checkEvents())
-    {
-        // DRAWING STARTS HERE
-
-        // clear screen
-        SDL_FillRect(screen, 0, SDL_MapRGB(screen->format, 255, 255, 255));
-
-        // draw bitmap
-        SDL_BlitSurface(renderTexture, 0, screen, &dstrect);
-
-        // DRAWING ENDS HERE
-
-        // finally, update the screen :)
-        SDL_Flip(screen);
-    } // end main loop
-
-	//save output texture
+	//work out the output filename
 	char stripped[256];
-	char outName[256];
+	//room for the longest stripped name and the numbers
+	char outName[sizeof(stripped) + 64];
 	int start = 0, end = 0;
 	for(int i = strlen(argv[1]) - 1; i>=0; i--)
 	{
@@ -161,7 +358,27 @@ int main ( int argc, char** argv )
 		stripped[i] = argv[1][n];
 	stripped[i] = '\0';
 
-	sprintf(outName, "synthesizedTextures/%s-%dx%d,%d.bmp", stripped, outputSize, outputSize, textonDiameter);
+	//stream it straight to the file if it's asked for, there is nothing to show
+	if(!seeded)
+		params.seed = time(NULL);
+	debug("The random noise will come from seed %u\n", params.seed);
+	if(runSelfTest)
+		return selfTest(inputTexture, outputSize, params) == 0 ? 0 : 1;
+	if(streamOutput)
+	{
+		snprintf(outName, sizeof(outName), "synthesizedTextures/%s-%dx%d,%d.ppm", stripped, outputSize, outputSize, params.diameter);
+		return streamTextureSynthesis(inputTexture, outputSize, outputSize, params, outName) ? 0 : 1;
+	}
+
+    //run the texture synthesis
+	//in its own thread, so the window can be redrawn and closed while it works
+	params.progress = showProgress;
+	preview_window preview(screen, previewFps);
+	params.progressData = &preview;
+	preview.run(synthesize, NULL);
+
+	//save output texture
+	snprintf(outName, sizeof(outName), "synthesizedTextures/%s-%dx%d,%d.bmp", stripped, outputSize, outputSize, params.diameter);
 	debug("Saving the output image to %s\n", outName);
 	if(SDL_SaveBMP(outputTexture, outName) < 0)
 	{
@@ -169,6 +386,35 @@ int main ( int argc, char** argv )
 		exit(EXIT_FAILURE);
 	}
 
+	//show it until the window is closed, unless there is no window
+	if(screen)
+	{
+		//this is the texture that will be rendered on screen:
+		SDL_Surface *renderTexture = outputTexture;
+	    // centre the bitmap on screen
+	    SDL_Rect dstrect;
+	    dstrect.x = (screen->w - renderTexture->w) / 2;
+	    dstrect.y = (screen->h - renderTexture->h) / 2;
+
+	    // program main loop
+	    debug("Entering display loop...\n");
+	    while (!checkEvents())
+	    {
+	        // DRAWING STARTS HERE
+
+	        // clear screen
+	        SDL_FillRect(screen, 0, SDL_MapRGB(screen->format, 255, 255, 255));
+
+	        // draw bitmap
+	        SDL_BlitSurface(renderTexture, 0, screen, &dstrect);
+
+	        // DRAWING ENDS HERE
+
+	        // finally, update the screen :)
+	        SDL_Flip(screen);
+	    } // end main loop
+	}
+
 	debug("Cleaning up\n");
     // free loaded bitmap
     SDL_FreeSurface(inputTexture);
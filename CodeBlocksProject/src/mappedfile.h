@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#ifndef MAPPEDFILE_H_INCLUDED
+#define MAPPEDFILE_H_INCLUDED
+
+/*
+ * This file contains a read only file that is mapped into memory instead of read, so its
+ * contents can be used right where they are. Only the pages that are actually touched are
+ * ever loaded, and the operating system can share them between processes.
+ */
+
+#ifdef __APPLE__
+    #include <SDL/SDL.h>
+#else
+    #include <SDL.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
+	#include <windows.h>
+#endif
+#include "util.h"	//debug()
+
+class mapped_file
+{
+public:
+	mapped_file();
+	//unmaps the file if it is still mapped
+	~mapped_file();
+
+	//maps all of filename into memory. returns false if it can't be opened or mapped.
+	bool open(const char *filename);
+
+	//unmaps the file. everything from getData() is gone after this.
+	void close();
+
+	//the contents of the file, NULL if nothing is mapped. they can't be written to.
+	inline const Uint8 *getData()
+	{
+		return data;
+	}
+
+	inline size_t getSize()
+	{
+		return size;
+	}
+
+private:
+	const Uint8 *data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#endif
+};
+
+#endif // MAPPEDFILE_H_INCLUDED
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "parallelsyn.h"
+#include <string.h>	//memset()
+#include <math.h>	//floor()
+
+parallel_synthesis::parallel_synthesis(gauss_pyramid *in, hood_pyramid *hoods, gauss_pyramid *out, int level, int *f, similarity_sets *s, Uint64 k)
+{
+	inPyramid = in;
+	outPyramid = out;
+	squareHoods = hoods;
+	similar = s;
+	l = level;
+	field = f;
+	inLevel = inPyramid->getLevel(l);
+	outLevel = outPyramid->getLevel(l);
+	inW = inLevel->w;
+	inH = inLevel->h;
+	outW = outLevel->w;
+	outH = outLevel->h;
+	key = k;
+	subX = subY = 0;
+}
+
+void parallel_synthesis::initialize(const int *parentField, float jitter)
+{
+	if(parentField)
+		upsampleField(inPyramid, outPyramid, l, parentField, field);
+
+	for(int y = 0; y < outH; y++)
+		for(int x = 0; x < outW; x++)
+		{
+			int &source = field[y * outW + x];
+			if(!parentField)
+			{
+				Uint32 r = counterRandom32(key, x, y, ~0u);
+				source = ((r / inW) % inH) * inW + r % inW;
+			}
+
+			//a random offset in [-jitter, jitter], rounded to the nearest pixel
+			float jx = counterRandom32(key, x, y, 0) / 4294967295.0f * 2 - 1;
+			float jy = counterRandom32(key, x, y, 1) / 4294967295.0f * 2 - 1;
+			int sx = wrapCoordinate(source % inW + (int)floor(jitter * jx + 0.5f), inW);
+			int sy = wrapCoordinate(source / inW + (int)floor(jitter * jy + 0.5f), inH);
+			source = sy * inW + sx;
+		}
+
+	for(int s = 0; s < 4; s++)
+		apply(s % 2, s / 2);
+}
+
+void parallel_synthesis::correct(worker_pool *pool, int pass)
+{
+	corrected.assign(field, field + outW * outH);
+	for(int s = 0; s < 4; s++)
+	{
+		subX = s % 2;
+		subY = s / 2;
+
+		//every other row starting at subY, the tasks only write to corrected
+		pool->run(correctRow, (void*)this, (outH - subY + 1) / 2);
+
+		for(int y = subY; y < outH; y += 2)
+			for(int x = subX; x < outW; x += 2)
+				field[y * outW + x] = corrected[y * outW + x];
+		apply(subX, subY);
+	}
+}
+
+void parallel_synthesis::correctRow(int i, void *data)
+{
+	parallel_synthesis *ps = (parallel_synthesis*) data;
+	int outW = ps->outW, outH = ps->outH, inW = ps->inW, inH = ps->inH;
+	int y = ps->subY + 2 * i;
+
+	const Uint8 *inData = ps->squareHoods->getLevelData(ps->l);
+	int stride = ps->squareHoods->getStride(ps->l);
+	ssd_bounded_func compare = fixedBoundedSSD(stride);
+	Uint8 *target = (Uint8*) alignedAlloc(stride, HOOD_ALIGN);
+	memset(target, 0, stride);
+	vector<int> candidates;
+
+	for(int x = ps->subX; x < outW; x += 2)
+	{
+		//the square around this pixel the way the output looks right now
+		hood::gatherSquare(ps->squareHoods->getSettings(), ps->outPyramid, ps->l, x, y, target);
+
+		//coherent candidates: where the 3x3 neighbors came from, moved back by their offset
+		candidates.clear();
+		for(int dy = -1; dy <= 1; dy++)
+			for(int dx = -1; dx <= 1; dx++)
+			{
+				int source = ps->field[wrapCoordinate(y + dy, outH) * outW + wrapCoordinate(x + dx, outW)];
+				int sx = wrapCoordinate(source % inW - dx, inW);
+				int sy = wrapCoordinate(source / inW - dy, inH);
+				ps->addCandidate(candidates, sy * inW + sx);
+			}
+		if(ps->similar)
+		{
+			int coherent = candidates.size(), k = ps->similar->getK();
+			for(int c = 0; c < coherent; c++)
+			{
+				const int *set = ps->similar->getSet(ps->l, candidates[c]);
+				for(int n = 0; n < k; n++)
+					if(set[n] >= 0)
+						ps->addCandidate(candidates, set[n]);
+			}
+		}
+
+		int best = -1;
+		Uint64 bestMatch = ~(Uint64)0;
+		for(int c = 0; c < candidates.size(); c++)
+		{
+			//one farther than the best so far can't win, not even a tie
+			Uint64 thisMatch = compare(inData + (size_t)candidates[c] * stride, target, stride, bestMatch);
+			//ties go to the earlier position so the order of the candidates doesn't matter
+			if(thisMatch < bestMatch || (thisMatch == bestMatch && candidates[c] < best))
+			{
+				bestMatch = thisMatch;
+				best = candidates[c];
+			}
+		}
+		ps->corrected[y * outW + x] = best;
+	}
+
+	alignedFree(target);
+}
+
+void parallel_synthesis::apply(int sx, int sy)
+{
+	image_view<Uint32> in = surfaceView(inLevel), out = surfaceView(outLevel);
+	for(int y = sy; y < outH; y += 2)
+		for(int x = sx; x < outW; x += 2)
+		{
+			int source = field[y * outW + x];
+			out.at(x, y) = in.at(source % inW, source / inW) | PIXEL_OPAQUE;
+		}
+}
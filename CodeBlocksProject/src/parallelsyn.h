@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef PARALLELSYN_H_INCLUDED
+#define PARALLELSYN_H_INCLUDED
+
+/*
+ * This file contains the parallel synthesis (Lefebvre and Hoppe). A level isn't made
+ * one pixel after the other. Instead, every pixel gets the input coordinates under its
+ * parent on the coarser level, those are jittered a little, and a few correction passes
+ * fix them up. The corrections compare whole squares around the pixels, so nothing has to
+ * be done in order. Each pass is split into 2x2 sub-passes so the pixels of a sub-pass
+ * never see each other's changes, which means all of them can be done at the same time
+ * and the answer doesn't depend on how many threads there are.
+ */
+
+#ifdef __APPLE__
+    #include <SDL/SDL.h>
+#else
+    #include <SDL.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "util.h"			//debug()
+#include "sdl.h"			//surfaceView()
+#include "gauss_pyramid.h"	//gauss_pyramid class
+#include "hood.h"			//hood and hood_pyramid classes
+#include "ssd.h"			//ssd()
+#include "worker_pool.h"	//worker_pool class
+#include "kcoherence.h"		//similarity_sets class
+#include "patchmatch.h"		//upsampleField()
+#include "random.h"			//counterRandom32()
+
+using namespace std;
+
+class parallel_synthesis
+{
+public:
+	//works on level l of outPyramid using inPyramid and squareHoods, the hood::gatherSquare()
+	//neighborhoods of inPyramid. field holds the index (y * input width + x) of the input
+	//pixel every output pixel comes from, one per output pixel in scanline order.
+	//if similar isn't NULL (it must be made from squareHoods) the corrections also try the
+	//pixels most like every coherent candidate. the random numbers come from key (see random.h).
+	parallel_synthesis(gauss_pyramid *inPyramid, hood_pyramid *squareHoods, gauss_pyramid *outPyramid, int l, int *field, similarity_sets *similar, Uint64 key);
+
+	//fills in the field from parentField, the field of level l + 1, or with random pixels if
+	//it is NULL. every coordinate is then moved by up to jitter pixels in each direction.
+	//the output level is set to match.
+	void initialize(const int *parentField, float jitter);
+
+	//does one correction pass, which is four sub-passes, split up by rows between the
+	//threads of pool. the output level is updated after every sub-pass.
+	void correct(worker_pool *pool, int pass);
+
+private:
+	//the worker pool runs this for every row of the sub-pass
+	static void correctRow(int i, void *data);
+
+	//adds the input pixel i to candidates if it isn't there already
+	inline void addCandidate(vector<int> &candidates, int i)
+	{
+		for(int c = 0; c < candidates.size(); c++)
+			if(candidates[c] == i)
+				return;
+		candidates.push_back(i);
+	}
+
+	//copies the color of every output pixel's match in the sub-pass onto the output level
+	void apply(int subX, int subY);
+
+	gauss_pyramid *inPyramid, *outPyramid;
+	hood_pyramid *squareHoods;
+	similarity_sets *similar;
+	SDL_Surface *inLevel, *outLevel;
+	int l, inW, inH, outW, outH;
+	int *field;
+	Uint64 key;
+
+	//the sub-pass being worked on and the matches it found. they are only put in the
+	//field once the sub-pass is done.
+	int subX, subY;
+	vector<int> corrected;
+};
+
+#endif // PARALLELSYN_H_INCLUDED
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "patchmatch.h"
+#include <string.h>	//memset(), memcpy()
+
+void upsampleField(gauss_pyramid *inPyramid, gauss_pyramid *outPyramid, int l, const int *parentField, int *field)
+{
+	int inW = inPyramid->getLevel(l)->w, inH = inPyramid->getLevel(l)->h;
+	int outW = outPyramid->getLevel(l)->w, outH = outPyramid->getLevel(l)->h;
+	int parentOutW = outPyramid->getLevel(l + 1)->w, parentOutH = outPyramid->getLevel(l + 1)->h;
+	int parentInW = inPyramid->getLevel(l + 1)->w;
+
+	for(int y = 0; y < outH; y++)
+		for(int x = 0; x < outW; x++)
+		{
+			int parent = parentField[MIN(y / 2, parentOutH - 1) * parentOutW + MIN(x / 2, parentOutW - 1)];
+			int sx = wrapCoordinate((parent % parentInW) * 2 + x % 2, inW);
+			int sy = wrapCoordinate((parent / parentInW) * 2 + y % 2, inH);
+			field[y * outW + x] = sy * inW + sx;
+		}
+}
+
+patch_match::patch_match(gauss_pyramid *in, hood_pyramid *inHoods, gauss_pyramid *out, int level, int *f, Uint64 k)
+{
+	inPyramid = in;
+	outPyramid = out;
+	l = level;
+	field = f;
+	inLevel = inPyramid->getLevel(l);
+	outLevel = outPyramid->getLevel(l);
+	settings = inHoods->getSettings();
+	inData = inHoods->getLevelData(l);
+	stride = inHoods->getStride(l);
+	compare = fixedBoundedSSD(stride);
+	inW = inLevel->w;
+	inH = inLevel->h;
+	outW = outLevel->w;
+	outH = outLevel->h;
+	key = k;
+	iteration = radius = 0;
+}
+
+void patch_match::initialize(const int *parentField)
+{
+	if(parentField)
+		upsampleField(inPyramid, outPyramid, l, parentField, field);
+	else
+	{
+		for(int y = 0; y < outH; y++)
+			for(int x = 0; x < outW; x++)
+			{
+				Uint32 r = counterRandom32(key, x, y, ~0u);
+				field[y * outW + x] = ((r / inW) % inH) * inW + r % inW;
+			}
+	}
+	apply();
+}
+
+void patch_match::iterate(worker_pool *pool, int it, int r)
+{
+	iteration = it;
+	radius = (r > 0) ? r : MAX(inW, inH);
+
+	//the bands look at each other's matches from before this pass
+	before.assign(field, field + outW * outH);
+	pool->run(iterateBand, (void*)this, (outH + PATCHMATCH_BAND_ROWS - 1) / PATCHMATCH_BAND_ROWS);
+	apply();
+}
+
+void patch_match::iterateBand(int band, void *data)
+{
+	patch_match *pm = (patch_match*) data;
+	int outW = pm->outW, outH = pm->outH, inW = pm->inW, inH = pm->inH;
+	int by = band * PATCHMATCH_BAND_ROWS, ey = MIN(by + PATCHMATCH_BAND_ROWS, outH);
+
+	//forwards on even passes and backwards on odd ones, so good matches travel both ways
+	int step = (pm->iteration % 2 == 0) ? 1 : -1;
+	int firstY = (step > 0) ? by : ey - 1, lastY = (step > 0) ? ey : by - 1;
+	int firstX = (step > 0) ? 0 : outW - 1, lastX = (step > 0) ? outW : -1;
+
+	//the neighborhood of the output pixel being worked on
+	Uint8 *target = (Uint8*) alignedAlloc(pm->stride, HOOD_ALIGN);
+	memset(target, 0, pm->stride);
+
+	for(int y = firstY; y != lastY; y += step)
+	{
+		for(int x = firstX; x != lastX; x += step)
+		{
+			hood::gather(pm->settings, pm->outPyramid, pm->l, x, y, target);
+			int &best = pm->field[y * outW + x];
+			Uint64 bestDist = pm->distance(target, best);
+
+			//propagation: the pixel before this one in x and in y, moved over by one
+			for(int n = 0; n < 2; n++)
+			{
+				int nx = x - step * (n == 0), ny = y - step * (n == 1);
+				if(nx < 0 || nx >= outW || ny < 0 || ny >= outH)
+					continue;
+				int source = (ny >= by && ny < ey) ? pm->field[ny * outW + nx] : pm->before[ny * outW + nx];
+				int sx = wrapCoordinate(source % inW + step * (n == 0), inW);
+				int sy = wrapCoordinate(source / inW + step * (n == 1), inH);
+				int candidate = sy * inW + sx;
+				Uint64 d = pm->distance(target, candidate);
+				if(d < bestDist)
+				{
+					bestDist = d;
+					best = candidate;
+				}
+			}
+
+			//random search: look around the best match in smaller and smaller windows
+			int r = pm->radius;
+			for(int i = 0; r >= 1; r /= 2, i++)
+			{
+				Uint32 rx = counterRandom32(pm->key, y * outW + x, pm->iteration, 2 * i);
+				Uint32 ry = counterRandom32(pm->key, y * outW + x, pm->iteration, 2 * i + 1);
+				int sx = wrapCoordinate(best % inW + (int)(rx % (2 * r + 1)) - r, inW);
+				int sy = wrapCoordinate(best / inW + (int)(ry % (2 * r + 1)) - r, inH);
+				int candidate = sy * inW + sx;
+				Uint64 d = pm->distance(target, candidate);
+				if(d < bestDist)
+				{
+					bestDist = d;
+					best = candidate;
+				}
+			}
+		}
+	}
+
+	alignedFree(target);
+}
+
+void patch_match::apply()
+{
+	image_view<Uint32> in = surfaceView(inLevel), out = surfaceView(outLevel);
+	for(int y = 0; y < outH; y++)
+		for(int x = 0; x < outW; x++)
+		{
+			int source = field[y * outW + x];
+			out.at(x, y) = in.at(source % inW, source / inW) | PIXEL_OPAQUE;
+		}
+}
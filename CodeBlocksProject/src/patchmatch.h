@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef PATCHMATCH_H_INCLUDED
+#define PATCHMATCH_H_INCLUDED
+
+/*
+ * This file contains the PatchMatch search (Barnes et al.). Instead of looking for
+ * the best input neighborhood of every output pixel on its own, a whole level keeps a
+ * field of where every output pixel comes from and makes it better a few times over.
+ * Each pass hands good matches on to the next pixel (propagation) and tries random
+ * input pixels closer and closer to the current match (random search).
+ */
+
+#ifdef __APPLE__
+    #include <SDL/SDL.h>
+#else
+    #include <SDL.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include "util.h"			//debug()
+#include "sdl.h"			//surfaceView()
+#include "gauss_pyramid.h"	//gauss_pyramid class
+#include "hood.h"			//hood and hood_pyramid classes
+#include "ssd.h"			//ssd()
+#include "worker_pool.h"	//worker_pool class
+#include "random.h"		//counterRandom32()
+
+using namespace std;
+
+//fills in the field of level l (see patch_match) from parentField, the field of level l + 1.
+//every pixel of the parent covers 2x2 pixels on level l, so each of them gets the input pixel
+//at the same spot under the parent's match.
+void upsampleField(gauss_pyramid *inPyramid, gauss_pyramid *outPyramid, int l, const int *parentField, int *field);
+
+//how many rows of the output a pass task works on. propagation only crosses into the
+//rows of another task through the field as it was before the pass, so the result
+//only depends on this and not on how many threads there are.
+#define PATCHMATCH_BAND_ROWS 16
+
+class patch_match
+{
+public:
+	//works on level l of outPyramid, matching it against the same level of inPyramid and
+	//inHoods. field holds the index (y * input width + x) of the input pixel every
+	//output pixel comes from, one per output pixel in scanline order.
+	//the random numbers come from key (see random.h), every pixel of every pass gets its own.
+	patch_match(gauss_pyramid *inPyramid, hood_pyramid *inHoods, gauss_pyramid *outPyramid, int l, int *field, Uint64 key);
+
+	//fills in the field. if parentField isn't NULL it holds the field of level l + 1 and every pixel starts out at the input pixel under its parent's match,
+	//otherwise every pixel starts out somewhere random. the output level is set to match.
+	void initialize(const int *parentField);
+
+	//does one propagation and random search pass over the whole field and then copies
+	//the new matches to the output level. the random search starts radius pixels away
+	//from the current match (0 means the whole input) and halves it down to 1.
+	//the passes alternate between going forwards and backwards in scanline order.
+	void iterate(worker_pool *pool, int iteration, int radius);
+
+private:
+	//the worker pool runs this for every band of PATCHMATCH_BAND_ROWS rows
+	static void iterateBand(int band, void *data);
+
+	//copies the color of every output pixel's match onto the output level
+	void apply();
+
+	//returns the distance between the output neighborhood in target and input pixel i
+	inline Uint64 distance(const Uint8 *target, int i)
+	{
+		return compare(target, inData + (size_t)i * stride, stride, ~(Uint64)0);
+	}
+
+	gauss_pyramid *inPyramid, *outPyramid;
+	SDL_Surface *inLevel, *outLevel;
+	const hood_settings *settings;
+	const Uint8 *inData;
+	int l, stride, inW, inH, outW, outH;
+	//the kernel for neighborhoods stride bytes long (see fixedBoundedSSD())
+	ssd_bounded_func compare;
+	int *field;
+	Uint64 key;
+
+	//what the band tasks need to know about the pass being done
+	vector<int> before;
+	int iteration, radius;
+};
+
+#endif // PATCHMATCH_H_INCLUDED
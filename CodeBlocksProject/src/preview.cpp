@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#include "preview.h"
+
+preview_window::preview_window(SDL_Surface *s, int f)
+{
+	screen = s;
+	fps = MAX(f, 1);
+	mut = NULL;
+	changed = NULL;
+	snapshot = NULL;
+	published = 0;
+	finished = false;
+	lastPublish = 0;
+	work = NULL;
+	data = NULL;
+}
+
+//lets the main thread know when the work is done
+int preview_window::worker(void *data)
+{
+	preview_window *p = (preview_window*) data;
+	int toReturn = p->work(p->data);
+
+	SDL_mutexP(p->mut);
+	p->finished = true;
+	SDL_CondSignal(p->changed);
+	SDL_mutexV(p->mut);
+	return toReturn;
+}
+
+void preview_window::takeSnapshot(SDL_Surface *level)
+{
+	if(!snapshot || snapshot->w != level->w || snapshot->h != level->h)
+	{
+		//not createSurface(), SDL_DisplayFormat() has to be called by the thread with the window
+		SDL_FreeSurface(snapshot);
+		SDL_PixelFormat *f = level->format;
+		snapshot = SDL_CreateRGBSurface(SDL_SWSURFACE, level->w, level->h, f->BitsPerPixel, f->Rmask, f->Gmask, f->Bmask, f->Amask);
+		if(!snapshot)
+		{
+			fprintf(stderr, "ERROR creating the preview snapshot: %s\n", SDL_GetError());
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	int rowBytes = level->w * level->format->BytesPerPixel;
+	for(int y = 0; y < level->h; y++)
+		memcpy((Uint8*)snapshot->pixels + y * snapshot->pitch, (Uint8*)level->pixels + y * level->pitch, rowBytes);
+	published++;
+}
+
+void preview_window::publish(SDL_Surface *level)
+{
+	if(!mut)
+		return;
+
+	//most of the calls end here, so the preview costs next to nothing between frames
+	Uint32 now = SDL_GetTicks();
+	if(now - lastPublish < 1000 / (Uint32)fps)
+		return;
+	lastPublish = now;
+
+	SDL_mutexP(mut);
+	takeSnapshot(level);
+	SDL_CondSignal(changed);
+	SDL_mutexV(mut);
+}
+
+int preview_window::run(int (*w)(void*), void *d)
+{
+	if(!screen)
+		return w(d);
+
+	mut = SDL_CreateMutex();
+	changed = SDL_CreateCond();
+	published = 0;
+	finished = false;
+	lastPublish = 0;
+
+	work = w;
+	data = d;
+	SDL_Thread *thread = SDL_CreateThread(worker, (void*)this);
+	if(!thread)
+	{
+		fprintf(stderr, "ERROR starting the synthesis thread: %s\n", SDL_GetError());
+		exit(EXIT_FAILURE);
+	}
+
+	Uint32 frameTime = 1000 / fps;
+	int shown = 0;
+	SDL_mutexP(mut);
+	while(!finished)
+	{
+		//wait for something new, but not so long that the events go unanswered
+		SDL_CondWaitTimeout(changed, mut, frameTime);
+
+		//the events are handled with mut unlocked so the synthesis never waits on them
+		SDL_mutexV(mut);
+		if(checkEvents())
+		{
+			debug("Interrupt quit requested. Terminating.\n");
+			exit(EXIT_SUCCESS);
+		}
+		Uint32 frameStart = SDL_GetTicks();
+		SDL_mutexP(mut);
+
+		if(published != shown)
+		{
+			shown = published;
+
+			// centre the snapshot on screen
+			SDL_Rect dstrect;
+			dstrect.x = (screen->w - snapshot->w) / 2;
+			dstrect.y = (screen->h - snapshot->h) / 2;
+
+			// clear screen and draw it
+			SDL_FillRect(screen, 0, SDL_MapRGB(screen->format, 255, 255, 255));
+			SDL_BlitSurface(snapshot, 0, screen, &dstrect);
+
+			SDL_mutexV(mut);
+			SDL_Flip(screen);
+
+			//don't draw again until the next frame is due
+			Uint32 spent = SDL_GetTicks() - frameStart;
+			if(spent < frameTime)
+				SDL_Delay(frameTime - spent);
+			SDL_mutexP(mut);
+		}
+	}
+	SDL_mutexV(mut);
+
+	int toReturn = 0;
+	SDL_WaitThread(thread, &toReturn);
+
+	SDL_FreeSurface(snapshot);
+	snapshot = NULL;
+	SDL_DestroyCond(changed);
+	changed = NULL;
+	SDL_DestroyMutex(mut);
+	mut = NULL;
+	return toReturn;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#ifndef PREVIEW_H_INCLUDED
+#define PREVIEW_H_INCLUDED
+
+/*
+ * This file contains the live preview of the synthesis. The synthesis runs in its own thread
+ * and every so often copies the level it's working on into a snapshot. The main thread owns
+ * the window; it draws the newest snapshot at most fps times a second and handles the
+ * window's events the whole time, so drawing never holds up the synthesis and quitting
+ * doesn't have to wait for it.
+ */
+
+#ifdef __APPLE__
+    #include <SDL/SDL.h>
+    #include <SDL/SDL_thread.h>
+#else
+    #include <SDL.h>
+    #include <SDL_thread.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	//memcpy()
+#include "util.h"	//debug()
+#include "sdl.h"	//checkEvents()
+
+//how many times a second the preview is redrawn, at most, unless it's told otherwise
+#define PREVIEW_DEFAULT_FPS 30
+
+class preview_window
+{
+	public:
+		//draws on screen (the window initSDL() made, or NULL if there isn't one) at most fps
+		//times a second
+		preview_window(SDL_Surface *screen, int fps = PREVIEW_DEFAULT_FPS);
+
+		//runs work(data) in a new thread and shows what it publishes with publish() until it
+		//returns. if the window is closed or escape is pressed in the meantime, the program exits.
+		//without a window, work(data) is just run in this thread.
+		//returns what work returned.
+		int run(int (*work)(void*), void *data);
+
+		//called by the synthesis with the level it is working on. if it's time for a new frame, the
+		//level is copied into the snapshot the window draws, otherwise this only checks the time.
+		//does nothing if run() isn't showing anything.
+		void publish(SDL_Surface *level);
+
+	private:
+		//the thread the work runs in
+		static int worker(void *data);
+
+		//copies level into the snapshot, making a new one if the level's size changed.
+		//mut must be locked.
+		void takeSnapshot(SDL_Surface *level);
+
+		SDL_Surface *screen;
+		int fps;
+
+		//everything the two threads share, protected by mut
+		SDL_mutex *mut;
+		//signaled when a new snapshot is published and when the work is done
+		SDL_cond *changed;
+		//the newest copy of the level being synthesized and how many have been published
+		SDL_Surface *snapshot;
+		int published;
+		bool finished;
+
+		//only used by the publishing thread
+		Uint32 lastPublish;
+
+		//what the worker thread runs
+		int (*work)(void*);
+		void *data;
+};
+
+#endif // PREVIEW_H_INCLUDED
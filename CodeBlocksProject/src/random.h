@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef RANDOM_H_INCLUDED
+#define RANDOM_H_INCLUDED
+
+/*
+ * This file contains the random numbers the synthesis uses. There is no generator to carry
+ * around: every number is a hash (SplitMix64's) of a key made from the seed and a few counters,
+ * like the pixel it is for. The same seed always gives the same numbers, no matter which
+ * thread asks for them or in which order, and any pixel's number can be had without
+ * working out the ones before it.
+ */
+
+#ifdef __APPLE__
+    #include <SDL/SDL.h>
+#else
+    #include <SDL.h>
+#endif
+
+//what the random numbers are for, each gets its own key so they don't repeat each other
+#define RANDOM_NOISE		0
+#define RANDOM_PATCHMATCH	1
+#define RANDOM_PARALLEL		2
+
+//SplitMix64's output function, it scrambles z so every bit depends on all of them
+inline Uint64 splitMix(Uint64 z)
+{
+	z += 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+//the key of the RANDOM_* numbers for level l of a synthesis started from seed
+inline Uint64 randomKey(Uint64 seed, int kind, int l)
+{
+	return splitMix(splitMix(seed) ^ ((Uint64)kind << 32 | (Uint32)l));
+}
+
+//the random number for the counters (a, b, c) under key
+inline Uint64 counterRandom(Uint64 key, Uint32 a, Uint32 b, Uint32 c)
+{
+	return splitMix(splitMix(key ^ a) ^ ((Uint64)b << 32 | c));
+}
+
+//the same, as a 32 bit number
+inline Uint32 counterRandom32(Uint64 key, Uint32 a, Uint32 b, Uint32 c)
+{
+	return (Uint32)(counterRandom(key, a, b, c) >> 32);
+}
+
+#endif // RANDOM_H_INCLUDED
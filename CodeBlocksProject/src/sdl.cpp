@@ -19,9 +19,7 @@
 
 #include "sdl.h"
 
-SDL_Surface *screen;
-
-void initSDL(int width, int height)
+SDL_Surface *initSDL(int width, int height, bool headless)
 {
 	//see if the passed width and height are within range
 	int useWidth = MIN_WIDTH, useHeight = MIN_HEIGHT;
@@ -30,8 +28,8 @@ void initSDL(int width, int height)
 	if(height > MIN_HEIGHT && height < MAX_HEIGHT)
 		useHeight = height;
 
-    // initialize SDL video
-    if ( SDL_Init( SDL_INIT_VIDEO ) < 0 )
+    // initialize SDL video, or nothing at all if there is no display
+    if ( SDL_Init( headless ? 0 : SDL_INIT_VIDEO ) < 0 )
     {
         fprintf(stderr, "Unable to init SDL: %s\n", SDL_GetError() );
         exit(EXIT_FAILURE);
@@ -40,13 +38,18 @@ void initSDL(int width, int height)
     // make sure SDL cleans up before exit
     atexit(SDL_Quit);
 
+    // no window to make
+    if ( headless )
+        return NULL;
+
     // create a new window
-    screen = SDL_SetVideoMode(useWidth, useHeight, TEX_BPP, SDL_HWSURFACE|SDL_DOUBLEBUF);
+    SDL_Surface *screen = SDL_SetVideoMode(useWidth, useHeight, TEX_BPP, SDL_HWSURFACE|SDL_DOUBLEBUF);
     if ( !screen )
     {
         fprintf(stderr, "Unable to set 640x480 video: %s\n", SDL_GetError());
         exit(EXIT_FAILURE);
     }
+    return screen;
 }
 
 bool checkEvents()
@@ -76,6 +79,11 @@ bool checkEvents()
 
 void dispSurface(SDL_Surface *disp)
 {
+    // nothing to draw on
+    SDL_Surface *screen = SDL_GetVideoSurface();
+    if (!screen)
+        return;
+
     if (checkEvents())
     {
     	debug("Interrupt quit requested. Terminating.\n");
@@ -97,14 +105,25 @@ void dispSurface(SDL_Surface *disp)
 	SDL_Flip(screen);
 }
 
-SDL_Surface *createSurface(int width, int height)
+SDL_Surface *createSurface(int width, int height, const SDL_PixelFormat *like)
 {
-	//make a surface
-	SDL_Surface *aSurface = SDL_CreateRGBSurface(SDL_HWSURFACE, width, height, TEX_BPP, 0, 0, 0, 0);
-
-	//convert it to display type (just in case)
-	SDL_Surface *toReturn = SDL_DisplayFormat(aSurface);
-	SDL_FreeSurface(aSurface);
+	//always in system memory so the pixels can be used without locking it (see image_view.h),
+	//and in the display's format if there is one so it can be drawn without converting it
+	Uint32 rMask = 0x00ff0000, gMask = 0x0000ff00, bMask = 0x000000ff;
+	SDL_Surface *screen = SDL_GetVideoSurface();
+	if(like && like->BitsPerPixel == TEX_BPP)
+	{
+		rMask = like->Rmask;
+		gMask = like->Gmask;
+		bMask = like->Bmask;
+	}
+	else if(screen && screen->format->BitsPerPixel == TEX_BPP)
+	{
+		rMask = screen->format->Rmask;
+		gMask = screen->format->Gmask;
+		bMask = screen->format->Bmask;
+	}
+	SDL_Surface *toReturn = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, TEX_BPP, rMask, gMask, bMask, 0);
 
 	//make sure everything went ok
 	if( !toReturn )
@@ -120,87 +139,58 @@ SDL_Surface *createSurface(int width, int height)
 	return toReturn;
 }
 
-void noisify(SDL_Surface *input)
-{
-	//seed the random number generator
-	srand( time( NULL ) );
+SDL_Surface *convertSurface(SDL_Surface *surface)
+{
+	//convert it to whatever format createSurface() makes
+	SDL_Surface *like = createSurface(1, 1);
+	SDL_Surface *toReturn = SDL_ConvertSurface(surface, like->format, SDL_SWSURFACE);
+	SDL_FreeSurface(like);
 
-	//the surface must be locked in order to access the pixels directly
-	SDL_LockSurface(input);
+	if( !toReturn )
+	{
+		fprintf(stderr, "ERROR converting surface: %s\n", SDL_GetError());
+		exit( EXIT_FAILURE );
+	}
+	return toReturn;
+}
 
+void noisify(SDL_Surface *input, unsigned int seed)
+{
 	//the surface's pixels can be directly manipulated via input->pixels.
 	//this should be in the format RGBA with 32 bits per pixel = 8 bits per componet
 	//not going to do anything with the Alpha values for now. may add something later
-
-	//loop through it all in scanline order
-	for(int c = 0; c < input->w; c++)
-	{
-		for(int r = 0; r < input->h; r++)
-		{
-			Uint8 red = rand() % 255;
-			Uint8 green = rand() % 255;
-			Uint8 blue = rand() % 255;
-
-			//and set it
-			Uint32 *pixels = (Uint32 *) input->pixels;
-			pixels[ (c * input->w) + r ] = SDL_MapRGB(input->format, red, green, blue);
-		}
-	}
+	SDL_LockSurface(input);
+	image_view<Uint32> pixels = surfaceView(input);
+	for(int y = 0; y < input->h; y++)
+		noisifyRow(pixels.row(y), input->w, y, seed, input->format);
 
 	//the surface must be unlocked for it to be used elsewhere
 	SDL_UnlockSurface(input);
 }
 
-Uint32 getPixel( SDL_Surface *surface, int x, int y )
+void noisifyRow(Uint32 *row, int w, int y, unsigned int seed, const SDL_PixelFormat *format, int l)
 {
-	if(x < 0 || x > surface->w || y < 0 || y > surface->h)
+	Uint64 key = randomKey(seed, RANDOM_NOISE, l);
+	for(int x = 0; x < w; x++)
 	{
-		//handle edge cases
-		x = (x + surface->w) % (surface->w);
-		y = (y + surface->h) % (surface->h);
+		//one random number is enough for all three channels
+		Uint64 r = counterRandom(key, x, y, 0);
+		Uint8 red = (r >> 48) % 255;
+		Uint8 green = ((r >> 32) & 0xffff) % 255;
+		Uint8 blue = ((r >> 16) & 0xffff) % 255;
+
+		//and set it
+		row[x] = SDL_MapRGB((SDL_PixelFormat *)format, red, green, blue);
 	}
+}
 
-	//lock surface
-	SDL_LockSurface(surface);
-
-	//Convert the pixels to 32 bit
-	Uint32 *pixels = (Uint32 *)surface->pixels;
-
-	//Get the requested pixel
-	Uint32 toReturn = pixels[ y * surface->w + x ];
-
-	//unlock surface
-	SDL_UnlockSurface(surface);
-
-	//return requested pixel
-	return toReturn;
+Uint32 getPixel( SDL_Surface *surface, int x, int y )
+{
+	return surfaceView(surface).wrapped(x, y);
 }
 
 void putPixel( SDL_Surface *surface, int x, int y, Uint32 pixel )
 {
-	if(x < 0 || x > surface->w || y < 0 || y > surface->h)
-	{
-		//handle edge cases
-		x = (x + surface->w) % (surface->w);
-		y = (y + surface->h) % (surface->h);
-	}
-
 	//make sure it's fully opaque
-	pixel |= 0xff000000;
-
-	//lock surface
-	SDL_LockSurface(surface);
-
-	//Convert the pixels to 32 bit
-	Uint32 *pixels = (Uint32 *)surface->pixels;
-
-	//Set the pixel
-	pixels[ y * surface->w + x ] = pixel;
-
-	//unlock surface
-	SDL_UnlockSurface(surface);
-
-	Uint32 check = getPixel(surface, x, y);
-	if(check != pixel)
-		debug("WARNING: putPixel didn't take at (%d, %d)!\n", x, y);
+	surfaceView(surface).wrapped(x, y) = pixel | PIXEL_OPAQUE;
 }
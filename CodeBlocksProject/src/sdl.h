@@ -30,6 +30,8 @@
 #include <stdlib.h>
 #include "util.h"		//debug()
 #include <time.h>	//time(NULL) used to seed random number generator
+#include "image_view.h"	//surfaceView()
+#include "random.h"		//counterRandom()
 
 #ifdef __APPLE__
     #include <SDL/SDL.h>
@@ -39,17 +41,19 @@
 
 //how many bits per pixel to use with sdl surfaces
 #define TEX_BPP 32
+//the alpha bits of a 32 bit pixel, set on every synthesized pixel
+#define PIXEL_OPAQUE 0xff000000
 //minimum / maximum windows sizes
 #define MAX_WIDTH 1270
 #define MIN_WIDTH 640
 #define MAX_HEIGHT 900
 #define MIN_HEIGHT 480
 
-extern SDL_Surface *screen;
-
 //initializes sdl with window width and height passed unless smaller
-//than the minimum or greater than the maximum
-void initSDL(int width = MIN_WIDTH, int height = MIN_HEIGHT);
+//than the minimum or greater than the maximum, and returns the window's surface.
+//if headless is true, the video subsystem isn't started and no window is made, so the program
+//can run without a display. then NULL is returned and dispSurface() doesn't do anything.
+SDL_Surface *initSDL(int width = MIN_WIDTH, int height = MIN_HEIGHT, bool headless = false);
 
 //checks for events that should end the program like pressing esc
 //or telling it to close
@@ -62,15 +66,27 @@ void dispSurface(SDL_Surface *disp);
 
 //This is a wrapper function that creates an SDL_Surface with specified
 //dimensions that is TEX_BPP bits per pixel laid out in RGBA format.
-SDL_Surface *createSurface(int width, int height);
+//it is always a software surface, so surfaceView() can be used on it without locking it.
+//if like isn't NULL the channels are laid out like they are in it instead of like the display's.
+SDL_Surface *createSurface(int width, int height, const SDL_PixelFormat *like = NULL);
+
+//returns a copy of the passed surface in the same format createSurface() uses
+SDL_Surface *convertSurface(SDL_Surface *surface);
+
+//takes the given surface and generates random noise for all pixels from seed.
+//every pixel's noise only depends on seed and where it is (see random.h).
+void noisify(SDL_Surface *input, unsigned int seed);
 
-//takes the given surface and generates random noise for all pixels
-void noisify(SDL_Surface *input);
+//fills the w pixels of row y with the noise noisify() would put there, so a texture can be
+//made a row at a time, in any order (see tex_syn_context::stream()). every l gets noise of
+//its own, l 0 is noisify()'s.
+void noisifyRow(Uint32 *row, int w, int y, unsigned int seed, const SDL_PixelFormat *format, int l = 0);
 
-//gets the pixel at (x, y) in the passed surface
+//gets the pixel at (x, y) in the passed surface, wrapping around the edges.
+//for more than the odd pixel, use surfaceView() instead.
 Uint32 getPixel( SDL_Surface *surface, int x, int y );
 
-//sets the pixel at (x, y) on the passed surface to be the passed pixel value
+//sets the pixel at (x, y) on the passed surface to be the passed pixel value, made opaque
 void putPixel( SDL_Surface *surface, int x, int y, Uint32 pixel );
 
 #endif // SDL_H_INCLUDED
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "selftest.h"
+#include "random.h"	//counterRandom32()
+#ifdef _MSC_VER
+	//older visual studios only have it with an underscore
+	#define snprintf _snprintf
+#endif
+
+//the longest neighborhoods the comparison kernels are checked on, in SSD_ALIGN chunks
+#define SELF_TEST_SSD_CHUNKS 16
+
+//returns true if a and b are the same size and have the same pixels
+static bool samePixels(SDL_Surface *a, SDL_Surface *b)
+{
+	if(!a || !b || a->w != b->w || a->h != b->h)
+		return false;
+	image_view<Uint32> pa = surfaceView(a), pb = surfaceView(b);
+	for(int y = 0; y < a->h; y++)
+		if(memcmp(pa.row(y), pb.row(y), a->w * sizeof(Uint32)) != 0)
+			return false;
+	return true;
+}
+
+//prints how the check called what went and adds it to *failed if it didn't pass
+static void report(bool passed, int *failed, const char *what)
+{
+	debug("SELF TEST %s: %s\n", passed ? "passed" : "FAILED", what);
+	if(!passed)
+		(*failed)++;
+}
+
+//synthesizes with params and checks that it's the same as reference, then frees it
+static void checkSame(const tex_syn_context &context, int size, const tex_syn_params &params, SDL_Surface *reference, int *failed, const char *what)
+{
+	SDL_Surface *texture = context.synthesize(size, size, params);
+	report(samePixels(texture, reference), failed, what);
+	SDL_FreeSurface(texture);
+}
+
+//returns true if the bounded kernel compare gives what it should for the first n bytes of a and
+//b with bound, whose exact distance is exact: exact if it's <= bound, otherwise more than bound
+static bool boundedRight(ssd_bounded_func compare, const Uint8 *a, const Uint8 *b, int n, Uint64 bound, Uint64 exact)
+{
+	Uint64 got = compare(a, b, n, bound);
+	return exact <= bound ? got == exact : got > bound;
+}
+
+//checks every comparison kernel this cpu can run, and both kinds of fixed length ones initSSD()
+//picked, against the plain one on random neighborhoods of every length up to SELF_TEST_SSD_CHUNKS chunks
+static void checkKernels(unsigned int seed, int *failed)
+{
+	int longest = SELF_TEST_SSD_CHUNKS * SSD_ALIGN;
+	Uint8 *a = (Uint8*) alignedAlloc(longest, SSD_ALIGN), *b = (Uint8*) alignedAlloc(longest, SSD_ALIGN);
+	Uint64 key = randomKey(seed, RANDOM_NOISE, -1);
+	for(int i = 0; i < longest; i++)
+	{
+		a[i] = (Uint8)counterRandom32(key, 0, i, 0);
+		b[i] = (Uint8)counterRandom32(key, 1, i, 0);
+	}
+
+	//the last ones are the fixed length kernels
+	const char *names[] = { "scalar", "sse2", "avx2", "avx512", "fixed length", "whole fixed length" };
+	ssd_func scalar = getSSD("scalar");
+	for(int k = 0; k < 6; k++)
+	{
+		bool fixed = k >= 4, whole = k == 5;
+		ssd_func full = fixed ? NULL : getSSD(names[k]);
+		ssd_bounded_func bounded = fixed ? NULL : getBoundedSSD(names[k]);
+		if(!fixed && !full)
+		{
+			debug("SELF TEST: this cpu can't run the %s kernel, it isn't checked\n", names[k]);
+			continue;
+		}
+
+		bool same = true;
+		for(int n = SSD_ALIGN; n <= longest; n += SSD_ALIGN)
+		{
+			if(fixed)
+			{
+				if(n > SSD_FIXED_MAX)
+					break;
+				bounded = whole ? fixedSSD(n) : fixedBoundedSSD(n);
+			}
+			Uint64 exact = scalar(a, b, n);
+			//the whole ones never stop early
+			if(whole && bounded(a, b, n, 0) != exact)
+				same = false;
+			if(full && full != scalar && full(a, b, n) != exact)
+				same = false;
+			//no bound, one it just makes and ones it goes over at the start, in the middle and at the end
+			Uint64 bounds[] = { ~(Uint64)0, exact, 0, exact / 2, exact - 1 };
+			for(int i = 0; i < 5; i++)
+				if(!boundedRight(bounded, a, b, n, bounds[i], exact))
+					same = false;
+		}
+
+		char what[128];
+		snprintf(what, sizeof(what), "the %s comparison kernels give exact sums and stop at their bounds", names[k]);
+		report(same, failed, what);
+	}
+
+	alignedFree(a);
+	alignedFree(b);
+}
+
+//checks that the levels of a pyramid levels tall made from input, which are shrunk from the
+//planes kept from the level below, are the same as shrinking every level's surface on its own
+static void checkPyramid(SDL_Surface *input, int levels, worker_pool *pool, int *failed)
+{
+	gauss_pyramid pyramid(input, levels, false, pool);
+	bool same = true;
+	for(int l = 1; l < pyramid.getLevels(); l++)
+	{
+		SDL_Surface *shrunk = shrinkLevel(pyramid.getLevel(l - 1));
+		same = same && samePixels(shrunk, pyramid.getLevel(l));
+		SDL_FreeSurface(shrunk);
+	}
+	report(same, failed, "pyramid levels made from the kept planes against ones made on their own");
+}
+
+//checks that hood_window slides to byte for byte the same neighborhoods hood::gather() builds,
+//on every level of a pyramid levels tall made from input and with both kinds of edges
+static void checkWindow(SDL_Surface *input, int levels, const tex_syn_params &params, int *failed)
+{
+	//the same settings tex_syn_context makes
+	float weights[3] = { 1.0, 1.0, 1.0 };
+	if(params.weightedColors)
+	{
+		weights[0] = params.redWeight;
+		weights[1] = params.greenWeight;
+		weights[2] = params.blueWeight;
+	}
+	hood_settings settings(params.diameter, params.multiresolution, weights[0], weights[1], weights[2]);
+	gauss_pyramid pyramid(input, levels);
+
+	for(int wrap = 0; wrap < 2; wrap++)
+	{
+		for(int l = 0; l < pyramid.getLevels(); l++)
+		{
+			//in scanline order, the way the synthesis moves it
+			hood_window window(&settings, &pyramid, l, wrap);
+			SDL_Surface *level = pyramid.getLevel(l);
+			bool same = true;
+			for(int y = 0; y < level->h && same; y++)
+			{
+				for(int x = 0; x < level->w && same; x++)
+				{
+					const Uint8 *slid = window.move(&pyramid, x, y);
+					hood gathered(&settings, &pyramid, l, x, y, false, wrap);
+					same = gathered.getStride() == window.getStride() && memcmp(slid, gathered.getChannels(), window.getStride()) == 0;
+				}
+			}
+
+			char what[80];
+			sprintf(what, "sliding window against gather on level %d with %s edges", l, wrap ? "wrapped" : "clamped");
+			report(same, failed, what);
+		}
+	}
+}
+
+//the checks of one search. exhaustive is what the exhaustive search made with the same params,
+//or NULL if it hasn't been run yet. returns the texture the search made with params.
+static SDL_Surface *checkSearch(SDL_Surface *input, int size, const tex_syn_params &params, SDL_Surface *exhaustive, int *failed)
+{
+	debug("SELF TEST: checking the %s search\n", searchName(params.search));
+	tex_syn_context context(input, tex_syn_context::levelsFor(size, size), params);
+	SDL_Surface *reference = context.synthesize(size, size, params);
+
+	//the same seed always gives the same texture, whichever thread does what
+	checkSame(context, size, params, reference, failed, "the same seed twice");
+	tex_syn_params single = params;
+	single.threads = params.threads > 0 ? 0 : 2;
+	checkSame(context, size, single, reference, failed, "with and without threads");
+
+	//keeping the coarse terms of the distances (see tex_syn_params::coarseTermsMemory) doesn't
+	//change them, however few are kept. they're only kept from diameter 11 or so up.
+	if(params.search == TEX_SYN_SEARCH_EXHAUSTIVE)
+	{
+		tex_syn_params uncached = params, oneParent = params;
+		uncached.coarseTermsMemory = 0;
+		oneParent.coarseTermsMemory = 1;
+		checkSame(context, size, uncached, reference, failed, "with and without the coarse terms kept");
+		checkSame(context, size, oneParent, reference, failed, "with the coarse terms of one parent kept");
+	}
+
+	//the fft search finds the same distances the exhaustive search does
+	if(params.search == TEX_SYN_SEARCH_FFT && exhaustive)
+		report(samePixels(reference, exhaustive), failed, "fft against exhaustive");
+
+	//the wavefront order only changes which pixels are done at the same time. with wrapped
+	//edges every pixel depends on the one before it, so it has to be checked on clamped ones.
+	if(params.search != TEX_SYN_SEARCH_PATCHMATCH && params.search != TEX_SYN_SEARCH_PARALLEL && params.search != TEX_SYN_SEARCH_FFT)
+	{
+		tex_syn_params scanline = params, wavefront = params;
+		scanline.edges = wavefront.edges = TEX_SYN_EDGES_CLAMP;
+		scanline.order = TEX_SYN_ORDER_SCANLINE;
+		wavefront.order = TEX_SYN_ORDER_WAVEFRONT;
+		SDL_Surface *clamped = context.synthesize(size, size, scanline);
+		checkSame(context, size, wavefront, clamped, failed, "scanline against wavefront order");
+		SDL_FreeSurface(clamped);
+	}
+
+	return reference;
+}
+
+int selfTest(SDL_Surface *input, int size, const tex_syn_params &params)
+{
+	int failed = 0;
+	tex_syn_params p = params;
+	p.progress = NULL;
+	p.progressData = NULL;
+
+	checkKernels(p.seed, &failed);
+	worker_pool *pool = p.threads > 0 ? new worker_pool(p.threads) : NULL;
+	checkPyramid(input, tex_syn_context::levelsFor(size, size), pool, &failed);
+	delete pool;
+	checkWindow(input, tex_syn_context::levelsFor(size, size), p, &failed);
+
+	//every search, the exhaustive one first so the fft search can be held up against it
+	SDL_Surface *exhaustive = NULL;
+	for(int s = 0; s < TEX_SYN_SEARCHES; s++)
+	{
+		p.search = s;
+		SDL_Surface *texture = checkSearch(input, size, p, exhaustive, &failed);
+		if(s == TEX_SYN_SEARCH_EXHAUSTIVE)
+			exhaustive = texture;
+		else
+			SDL_FreeSurface(texture);
+	}
+	SDL_FreeSurface(exhaustive);
+
+	if(failed)
+		debug("SELF TEST: %d checks FAILED\n", failed);
+	else
+		debug("SELF TEST: every check passed\n");
+	return failed;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef SELFTEST_H_INCLUDED
+#define SELFTEST_H_INCLUDED
+
+/*
+ * This file contains the self test. It runs the things that are supposed to give exactly the
+ * same texture against each other on a real input: every search twice with the same seed and
+ * with and without threads, the scanline order against the wavefront order, the sliding
+ * neighborhoods against the ones built from scratch, and so on. Any difference is a bug,
+ * not a rounding error, since everything the synthesis does is exact.
+ */
+
+#ifdef __APPLE__
+    #include <SDL/SDL.h>
+#else
+    #include <SDL.h>
+#endif
+#include "util.h"		//debug()
+#include "tex_syn.h"	//tex_syn_context class
+
+//runs every check on size x size textures synthesized from input with params (its diameter,
+//threads, seed and so on) and prints what happened with debug(). returns how many checks failed.
+int selfTest(SDL_Surface *input, int size, const tex_syn_params &params);
+
+#endif // SELFTEST_H_INCLUDED
@@ -0,0 +1,479 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "server.h"
+#include <string.h>			//strcmp(), strncpy()
+#include <time.h>			//time_t
+#ifndef _WIN32
+	#include <sys/types.h>
+	#include <sys/stat.h>	//stat()
+	#include <sys/socket.h>
+	#include <sys/select.h>
+	#include <sys/un.h>		//sockaddr_un
+	#include <unistd.h>		//read(), write(), close(), unlink()
+	#include <signal.h>		//signal()
+#endif
+#ifdef __APPLE__
+    #include <SDL/SDL_image.h>
+#else
+    #include <SDL_image.h>
+#endif
+#ifdef _MSC_VER
+	//older visual studios only have it with an underscore
+	#define snprintf _snprintf
+#endif
+
+//a hash of the pixels of surface, which is the name the exemplar goes by
+static Uint64 exemplarHash(SDL_Surface *surface)
+{
+	int size[] = { surface->w, surface->h };
+	Uint64 hash = analysis_cache::hash(ANALYSIS_HASH_START, size, sizeof(size));
+	image_view<Uint32> pixels = surfaceView(surface);
+	for(int y = 0; y < surface->h; y++)
+		hash = analysis_cache::hash(hash, pixels.row(y), surface->w * sizeof(Uint32));
+	return hash;
+}
+
+tex_syn_server::tex_syn_server(const tex_syn_params &d, size_t b)
+{
+	defaults = d;
+	//nobody to show the progress to
+	defaults.progress = NULL;
+	budget = b;
+	used = 0;
+	hits = misses = 0;
+	stopping = false;
+	mutex = SDL_CreateMutex();
+	ready = SDL_CreateCond();
+}
+
+tex_syn_server::~tex_syn_server()
+{
+	for(list<cache_entry*>::iterator i = entries.begin(); i != entries.end(); i++)
+		destroy(*i);
+	SDL_DestroyCond(ready);
+	SDL_DestroyMutex(mutex);
+}
+
+#ifdef _WIN32
+
+bool tex_syn_server::serve(const char *path)
+{
+	fprintf(stderr, "ERROR: the server needs unix domain sockets, it doesn't run on windows\n");
+	return false;
+}
+
+int tex_syn_server::serveConnection(void *data)
+{
+	return 0;
+}
+
+#else
+
+bool tex_syn_server::serve(const char *path)
+{
+	//a client that goes away before it gets its answer shouldn't take the server with it
+	signal(SIGPIPE, SIG_IGN);
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(address.sun_path))
+	{
+		fprintf(stderr, "ERROR: the socket path %s is too long\n", path);
+		return false;
+	}
+	strcpy(address.sun_path, path);
+
+	//a server that didn't shut down cleanly leaves its socket behind
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(path);
+	if(listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0)
+	{
+		fprintf(stderr, "ERROR listening on %s\n", path);
+		if(listener >= 0)
+			close(listener);
+		return false;
+	}
+	debug("Serving synthesis jobs on %s with %lu bytes for analyses\n", path, (unsigned long) budget);
+
+	vector<connection*> connections;
+	SDL_mutexP(mutex);
+	while(!stopping)
+	{
+		SDL_mutexV(mutex);
+
+		//wait for a client, but not so long that a shutdown goes unnoticed
+		fd_set readable;
+		FD_ZERO(&readable);
+		FD_SET(listener, &readable);
+		timeval timeout;
+		timeout.tv_sec = 0;
+		timeout.tv_usec = SERVER_POLL_MS * 1000;
+		if(select(listener + 1, &readable, NULL, NULL, &timeout) > 0)
+		{
+			int client = accept(listener, NULL, NULL);
+			if(client >= 0)
+			{
+				connection *c = new connection;
+				c->server = this;
+				c->socket = client;
+				c->done = false;
+				c->thread = SDL_CreateThread(serveConnection, (void*)c);
+				if(c->thread)
+					connections.push_back(c);
+				else
+				{
+					//nobody is going to answer it
+					debug("WARNING: couldn't start a thread for a client: %s\n", SDL_GetError());
+					close(client);
+					delete c;
+				}
+			}
+		}
+
+		//clean up after the clients that are gone
+		SDL_mutexP(mutex);
+		for(int i = 0; i < connections.size(); i++)
+		{
+			if(!connections[i]->done)
+				continue;
+			SDL_mutexV(mutex);
+			SDL_WaitThread(connections[i]->thread, NULL);
+			close(connections[i]->socket);
+			delete connections[i];
+			connections.erase(connections.begin() + i--);
+			SDL_mutexP(mutex);
+		}
+	}
+	SDL_mutexV(mutex);
+
+	//stop taking clients and let the ones that are connected finish the job they're on.
+	//their sockets are still open, even if their threads are done with them.
+	debug("Shutting down the server\n");
+	close(listener);
+	unlink(path);
+	for(int i = 0; i < connections.size(); i++)
+	{
+		shutdown(connections[i]->socket, SHUT_RD);
+		SDL_WaitThread(connections[i]->thread, NULL);
+		close(connections[i]->socket);
+		delete connections[i];
+	}
+	return true;
+}
+
+int tex_syn_server::serveConnection(void *data)
+{
+	connection *c = (connection*) data;
+	char line[SERVER_LINE_LENGTH];
+	char reply[SERVER_LINE_LENGTH];
+	int length = 0;
+
+	//split what comes in up into lines, one request each. a client that can't be
+	//answered is gone, so none of the requests it sent after that are run.
+	bool open = true;
+	while(open)
+	{
+		int got = read(c->socket, line + length, sizeof(line) - 1 - length);
+		if(got <= 0)
+			break;
+		length += got;
+
+		char *end;
+		while(open && (end = (char*) memchr(line, '\n', length)) != NULL)
+		{
+			*end = '\0';
+			if(end > line && end[-1] == '\r')
+				end[-1] = '\0';
+			c->server->handle(line, reply, sizeof(reply) - 1);
+			strcat(reply, "\n");
+			open = write(c->socket, reply, strlen(reply)) >= 0;
+
+			length -= end + 1 - line;
+			memmove(line, end + 1, length);
+		}
+
+		//nothing is ever that long
+		if(open && length == sizeof(line) - 1)
+		{
+			const char *tooLong = "error request too long\n";
+			write(c->socket, tooLong, strlen(tooLong));
+			break;
+		}
+	}
+
+	//serve() closes the socket once this thread is done, so it can still shut it down until then
+	SDL_mutexP(c->server->mutex);
+	c->done = true;
+	SDL_mutexV(c->server->mutex);
+	return 0;
+}
+
+#endif
+
+void tex_syn_server::handle(char *request, char *reply, int size)
+{
+	char command[32] = "";
+	sscanf(request, "%31s", command);
+
+	if(strcmp(command, "synthesize") == 0)
+		synthesize(request, reply, size);
+	else if(strcmp(command, "stats") == 0)
+	{
+		SDL_mutexP(mutex);
+		snprintf(reply, size, "ok %d %lu %lu %d %d", (int) entries.size(), (unsigned long) used, (unsigned long) budget, hits, misses);
+		SDL_mutexV(mutex);
+	}
+	else if(strcmp(command, "shutdown") == 0)
+	{
+		SDL_mutexP(mutex);
+		stopping = true;
+		SDL_mutexV(mutex);
+		snprintf(reply, size, "ok");
+	}
+	else
+		snprintf(reply, size, "error unknown request %s", command);
+}
+
+void tex_syn_server::synthesize(char *request, char *reply, int size)
+{
+	char exemplar[SERVER_LINE_LENGTH], search[32], output[SERVER_LINE_LENGTH];
+	int w, h, diameter;
+	unsigned int seed;
+	if(sscanf(request, "%*s %s %d %d %d %u %31s %s", exemplar, &w, &h, &diameter, &seed, search, output) != 7)
+	{
+		snprintf(reply, size, "error expected synthesize (exemplar) (width) (height) (diameter) (seed) (search) (output file)");
+		return;
+	}
+
+	tex_syn_params params = defaults;
+	params.search = searchNamed(search);
+	if(params.search < 0)
+	{
+		snprintf(reply, size, "error unknown search %s", search);
+		return;
+	}
+	if(w < 1 || h < 1 || diameter < 1)
+	{
+		snprintf(reply, size, "error bad size %d x %d or diameter %d", w, h, diameter);
+		return;
+	}
+	//the diameter is always odd, like on the command line
+	if(diameter % 2 == 0)
+		diameter++;
+	params.diameter = diameter;
+	params.seed = seed;
+
+	Uint32 start = SDL_GetTicks();
+	int levels = params.multiresolution ? tex_syn_context::levelsFor(w, h) : 1;
+	cache_entry *entry = acquire(exemplar, levels, diameter, params.search, reply, size);
+	if(!entry)
+		return;
+
+	debug("Synthesizing a %d x %d texture into %s\n", w, h, output);
+	SDL_Surface *texture = entry->context->synthesize(w, h, params);
+	Uint64 hash = entry->exemplar;
+	release(entry);
+
+	if(!texture)
+		snprintf(reply, size, "error the synthesis failed");
+	else if(SDL_SaveBMP(texture, output) < 0)
+		snprintf(reply, size, "error can't save %s: %s", output, SDL_GetError());
+	else
+		snprintf(reply, size, "ok %08x%08x %u", (Uint32)(hash >> 32), (Uint32)hash, SDL_GetTicks() - start);
+	if(texture)
+		SDL_FreeSurface(texture);
+}
+
+tex_syn_server::cache_entry *tex_syn_server::acquire(const char *exemplar, int levels, int diameter, int search, char *error, int size)
+{
+	SDL_Surface *input = NULL;
+	Uint64 hash = 0;
+	string path;
+	time_t modified = 0;
+	long fileSize = 0;
+
+	SDL_mutexP(mutex);
+	if(exemplar[0] == '#')
+	{
+		//an exemplar an earlier job used, copy it from that job's entry
+		unsigned int high = 0, low = 0;
+		if(strlen(exemplar + 1) == 16)
+			sscanf(exemplar + 1, "%8x%8x", &high, &low);
+		hash = ((Uint64)high << 32) | low;
+		cache_entry *known = findExemplar(hash);
+		if(known)
+		{
+			hash = known->exemplar;
+			path = known->path;
+			modified = known->modified;
+			fileSize = known->fileSize;
+			input = convertSurface(known->input);
+		}
+		SDL_mutexV(mutex);
+		if(!input)
+		{
+			snprintf(error, size, "error no exemplar %s", exemplar);
+			return NULL;
+		}
+	}
+	else
+	{
+		//only read the file if it changed since an entry was made from it
+		path = exemplar;
+#ifndef _WIN32
+		struct stat info;
+		if(stat(exemplar, &info) == 0)
+		{
+			modified = info.st_mtime;
+			fileSize = (long) info.st_size;
+		}
+#endif
+		cache_entry *known = findExemplar(exemplar, modified, fileSize);
+		if(known)
+		{
+			hash = known->exemplar;
+			input = convertSurface(known->input);
+		}
+		SDL_mutexV(mutex);
+
+		if(!input)
+		{
+			debug("Loading exemplar %s\n", exemplar);
+			SDL_Surface *loaded = IMG_Load(exemplar);
+			if(!loaded)
+			{
+				snprintf(error, size, "error can't load %s: %s", exemplar, SDL_GetError());
+				return NULL;
+			}
+			input = convertSurface(loaded);
+			SDL_FreeSurface(loaded);
+			hash = exemplarHash(input);
+		}
+	}
+
+	SDL_mutexP(mutex);
+	cache_entry *entry = NULL;
+	for(list<cache_entry*>::iterator i = entries.begin(); i != entries.end(); i++)
+	{
+		cache_entry *e = *i;
+		if(e->exemplar == hash && e->levels == levels && e->diameter == diameter && e->search == search)
+		{
+			//most recently used now
+			entry = e;
+			entries.erase(i);
+			entries.push_front(entry);
+			break;
+		}
+	}
+
+	if(entry)
+	{
+		//it might still be being made by another job
+		hits++;
+		entry->users++;
+		while(!entry->context)
+			SDL_CondWait(ready, mutex);
+		SDL_mutexV(mutex);
+		SDL_FreeSurface(input);
+		return entry;
+	}
+
+	//make it, without holding everybody else up
+	misses++;
+	entry = new cache_entry;
+	entry->exemplar = hash;
+	entry->path = path;
+	entry->modified = modified;
+	entry->fileSize = fileSize;
+	entry->levels = levels;
+	entry->diameter = diameter;
+	entry->search = search;
+	entry->input = input;
+	entry->context = NULL;
+	entry->size = 0;
+	entry->users = 1;
+	entries.push_front(entry);
+	SDL_mutexV(mutex);
+
+	debug("Analyzing exemplar %08x%08x for %d levels\n", (Uint32)(hash >> 32), (Uint32)hash, levels);
+	tex_syn_params params = defaults;
+	params.diameter = diameter;
+	params.search = search;
+	tex_syn_context *context = new tex_syn_context(input, levels, params);
+
+	SDL_mutexP(mutex);
+	entry->context = context;
+	entry->size = context->getMemoryUse() + (size_t)input->pitch * input->h;
+	used += entry->size;
+	SDL_CondBroadcast(ready);
+	evict();
+	SDL_mutexV(mutex);
+	return entry;
+}
+
+void tex_syn_server::release(cache_entry *entry)
+{
+	SDL_mutexP(mutex);
+	entry->users--;
+	evict();
+	SDL_mutexV(mutex);
+}
+
+tex_syn_server::cache_entry *tex_syn_server::findExemplar(const char *path, time_t modified, long fileSize)
+{
+	for(list<cache_entry*>::iterator i = entries.begin(); i != entries.end(); i++)
+		if((*i)->path == path && (*i)->modified == modified && (*i)->fileSize == fileSize && modified != 0)
+			return *i;
+	return NULL;
+}
+
+tex_syn_server::cache_entry *tex_syn_server::findExemplar(Uint64 exemplar)
+{
+	for(list<cache_entry*>::iterator i = entries.begin(); i != entries.end(); i++)
+		if((*i)->exemplar == exemplar)
+			return *i;
+	return NULL;
+}
+
+void tex_syn_server::evict()
+{
+	list<cache_entry*>::iterator i = entries.end();
+	while(used > budget && i != entries.begin())
+	{
+		i--;
+		cache_entry *entry = *i;
+		if(entry->users > 0 || !entry->context)
+			continue;
+
+		debug("Dropping the analysis of exemplar %08x%08x to stay under budget\n", (Uint32)(entry->exemplar >> 32), (Uint32)entry->exemplar);
+		used -= entry->size;
+		i = entries.erase(i);
+		destroy(entry);
+	}
+}
+
+void tex_syn_server::destroy(cache_entry *entry)
+{
+	//the context uses the input, it goes first
+	delete entry->context;
+	SDL_FreeSurface(entry->input);
+	delete entry;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef SERVER_H_INCLUDED
+#define SERVER_H_INCLUDED
+
+/*
+ * This file contains the synthesis server. It listens on a unix domain socket and runs
+ * synthesis jobs for whoever connects, keeping the analysis of the exemplars it has seen
+ * (see tex_syn_context) around so the next job with the same exemplar only has to synthesize.
+ * The analyses that were used the longest time ago are dropped once they take up more memory
+ * than the server is allowed.
+ *
+ * Every connection gets its own thread and can send any number of requests, one per line.
+ * Every request gets a one line answer that starts with "ok" or "error":
+ *		synthesize (exemplar) (width) (height) (diameter) (seed) (search) (output file)
+ *			synthesizes a texture and saves it to output file as a bitmap. exemplar is the path
+ *			of an image file or # followed by the hash an earlier job answered with, then the
+ *			image doesn't even have to be read again. search is one of the --search names.
+ *			answers "ok (hash) (milliseconds)".
+ *		stats
+ *			answers "ok (analyses) (bytes used) (byte budget) (hits) (misses)".
+ *		shutdown
+ *			answers "ok", then stops taking connections and exits once the jobs are done.
+ * Paths can't have spaces in them. Jobs from different connections run at the same time, even
+ * on the same analysis.
+ */
+
+#ifdef __APPLE__
+    #include <SDL/SDL.h>
+    #include <SDL/SDL_thread.h>
+#else
+    #include <SDL.h>
+    #include <SDL_thread.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <list>
+#include <vector>
+#include <string>
+#include "util.h"		//debug()
+#include "tex_syn.h"	//tex_syn_context class
+
+using namespace std;
+
+//how many megabytes of analyses the server keeps by default
+#define SERVER_DEFAULT_MEMORY 512
+//how long a request line can be
+#define SERVER_LINE_LENGTH 1024
+//how often the server checks if it was told to shut down, in milliseconds
+#define SERVER_POLL_MS 250
+
+class tex_syn_server
+{
+public:
+	//jobs are run with defaults, other than what the requests pick. the analyses are
+	//dropped once they take up more than budget bytes.
+	tex_syn_server(const tex_syn_params &defaults, size_t budget);
+	~tex_syn_server();
+
+	//listens on the socket at path and serves jobs until one asks it to shut down.
+	//returns false if it couldn't listen there.
+	bool serve(const char *path);
+
+private:
+	//the analysis of one exemplar for one set of settings
+	struct cache_entry
+	{
+		//hash of the exemplar's pixels, and the file they came from if they did
+		Uint64 exemplar;
+		string path;
+		time_t modified;
+		long fileSize;
+
+		//what the analysis was made for
+		int levels, diameter, search;
+
+		//the exemplar, owned by the entry
+		SDL_Surface *input;
+		//NULL while it is being made
+		tex_syn_context *context;
+		//bytes it takes up
+		size_t size;
+		//how many jobs are using it, it can't be dropped until that's 0
+		int users;
+	};
+
+	//a client and the thread serving it
+	struct connection
+	{
+		tex_syn_server *server;
+		//only closed by serve(), after the thread is done
+		int socket;
+		SDL_Thread *thread;
+		bool done;
+	};
+
+	//no copying
+	tex_syn_server(const tex_syn_server &);
+	tex_syn_server &operator=(const tex_syn_server &);
+
+	//reads requests from a connection until it closes
+	static int serveConnection(void *data);
+
+	//runs one request and writes its answer (without the newline) to reply
+	void handle(char *request, char *reply, int size);
+
+	//runs a synthesize request
+	void synthesize(char *request, char *reply, int size);
+
+	//returns the entry for the exemplar with those settings, making it if it has to. it is
+	//marked as used until release() is called. exemplar is like in a request. returns NULL
+	//and fills in error if the exemplar can't be found.
+	cache_entry *acquire(const char *exemplar, int levels, int diameter, int search, char *error, int size);
+	void release(cache_entry *entry);
+
+	//finds an entry for a file that hasn't changed since it was read, or for a hash.
+	//the mutex has to be locked.
+	cache_entry *findExemplar(const char *path, time_t modified, long fileSize);
+	cache_entry *findExemplar(Uint64 exemplar);
+
+	//drops the least recently used entries nobody is using until there are no more than
+	//budget bytes of them. the mutex has to be locked.
+	void evict();
+
+	//frees an entry that isn't in entries any more
+	void destroy(cache_entry *entry);
+
+	tex_syn_params defaults;
+	size_t budget, used;
+	int hits, misses;
+
+	//the most recently used entry first
+	list<cache_entry*> entries;
+	//protects everything above and stopping, ready is signalled whenever an entry's context is made
+	SDL_mutex *mutex;
+	SDL_cond *ready;
+
+	//set when a client asks the server to shut down
+	bool stopping;
+};
+
+#endif // SERVER_H_INCLUDED
@@ -0,0 +1,436 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "ssd.h"
+#include <string.h>	//strcmp()
+
+//the vector versions only get built for x86 compilers that know how to target them
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+	#define SSD_X86
+	#define SSD_TARGET(t) __attribute__((target(t)))
+	#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+	#define SSD_X86
+	#define SSD_TARGET(t)
+	#include <intrin.h>
+	#include <immintrin.h>
+#endif
+
+//a squared difference of two bytes is at most 255^2, so 32 bit sums are safe for this many bytes.
+//every kernel adds its 32 bit sums into the 64 bit total after each block this big.
+#define SSD_BLOCK 32768
+
+static Uint64 ssdScalar(const Uint8 *a, const Uint8 *b, int n)
+{
+	Uint64 total = 0;
+	for(int block = 0; block < n; block += SSD_BLOCK)
+	{
+		int end = MIN(n, block + SSD_BLOCK);
+		Uint32 sum = 0;
+		for(int i = block; i < end; i++)
+		{
+			int d = int(a[i]) - int(b[i]);
+			sum += d * d;
+		}
+		total += sum;
+	}
+	return total;
+}
+
+//the bounded versions add up SSD_BOUND_CHUNK bytes at a time, which is less than
+//SSD_BLOCK, and only look at the bound in between
+static Uint64 ssdBoundedScalar(const Uint8 *a, const Uint8 *b, int n, Uint64 bound)
+{
+	Uint64 total = 0;
+	for(int chunk = 0; chunk < n && total <= bound; chunk += SSD_BOUND_CHUNK)
+	{
+		int end = MIN(n, chunk + SSD_BOUND_CHUNK);
+		Uint32 sum = 0;
+		for(int i = chunk; i < end; i++)
+		{
+			int d = int(a[i]) - int(b[i]);
+			sum += d * d;
+		}
+		total += sum;
+	}
+	return total;
+}
+
+//the fixed length versions. they are never more than SSD_FIXED_MAX bytes and look at the
+//bound after every CHUNK bytes like the bounded ones, only with every loop a known length.
+//with CHUNK = N they add up everything and only sum the lanes once (see fixedSSD()).
+//the length they're passed is always N, so it isn't even named.
+template <int N, int CHUNK>
+static Uint64 ssdFixedScalar(const Uint8 *a, const Uint8 *b, int, Uint64 bound)
+{
+	Uint64 total = 0;
+	for(int chunk = 0; chunk < N && total <= bound; chunk += CHUNK)
+	{
+		Uint32 sum = 0;
+		for(int i = chunk; i < chunk + CHUNK; i++)
+		{
+			int d = int(a[i]) - int(b[i]);
+			sum += d * d;
+		}
+		total += sum;
+	}
+	return total;
+}
+
+#ifdef SSD_X86
+
+//adds the squared differences of the 16 bytes at a and b to the four 32 bit lanes of sum
+SSD_TARGET("sse2")
+static inline __m128i stepSSE2(__m128i sum, const Uint8 *a, const Uint8 *b)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i va = _mm_load_si128((const __m128i*)a);
+	__m128i vb = _mm_load_si128((const __m128i*)b);
+
+	//|a - b| without leaving 8 bits, then square and pair up in 32 bits
+	__m128i d = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+	__m128i lo = _mm_unpacklo_epi8(d, zero);
+	__m128i hi = _mm_unpackhi_epi8(d, zero);
+	sum = _mm_add_epi32(sum, _mm_madd_epi16(lo, lo));
+	return _mm_add_epi32(sum, _mm_madd_epi16(hi, hi));
+}
+
+//adds up the four lanes
+SSD_TARGET("sse2")
+static inline Uint32 lanesSSE2(__m128i sum)
+{
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (Uint32) _mm_cvtsi128_si32(sum);
+}
+
+SSD_TARGET("sse2")
+static Uint64 ssdSSE2(const Uint8 *a, const Uint8 *b, int n)
+{
+	Uint64 total = 0;
+	for(int block = 0; block < n; block += SSD_BLOCK)
+	{
+		int end = MIN(n, block + SSD_BLOCK);
+		__m128i sum = _mm_setzero_si128();
+		for(int i = block; i < end; i += 16)
+			sum = stepSSE2(sum, a + i, b + i);
+		total += lanesSSE2(sum);
+	}
+	return total;
+}
+
+SSD_TARGET("sse2")
+static Uint64 ssdBoundedSSE2(const Uint8 *a, const Uint8 *b, int n, Uint64 bound)
+{
+	Uint64 total = 0;
+	for(int chunk = 0; chunk < n && total <= bound; chunk += SSD_BOUND_CHUNK)
+	{
+		int end = MIN(n, chunk + SSD_BOUND_CHUNK);
+		__m128i sum = _mm_setzero_si128();
+		for(int i = chunk; i < end; i += 16)
+			sum = stepSSE2(sum, a + i, b + i);
+		total += lanesSSE2(sum);
+	}
+	return total;
+}
+
+template <int N, int CHUNK>
+SSD_TARGET("sse2")
+static Uint64 ssdFixedSSE2(const Uint8 *a, const Uint8 *b, int, Uint64 bound)
+{
+	Uint64 total = 0;
+	for(int chunk = 0; chunk < N && total <= bound; chunk += CHUNK)
+	{
+		__m128i sum = _mm_setzero_si128();
+		for(int i = chunk; i < chunk + CHUNK; i += 16)
+			sum = stepSSE2(sum, a + i, b + i);
+		total += lanesSSE2(sum);
+	}
+	return total;
+}
+
+SSD_TARGET("avx2")
+static inline __m256i stepAVX2(__m256i sum, const Uint8 *a, const Uint8 *b)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i va = _mm256_load_si256((const __m256i*)a);
+	__m256i vb = _mm256_load_si256((const __m256i*)b);
+
+	__m256i d = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+	__m256i lo = _mm256_unpacklo_epi8(d, zero);
+	__m256i hi = _mm256_unpackhi_epi8(d, zero);
+	sum = _mm256_add_epi32(sum, _mm256_madd_epi16(lo, lo));
+	return _mm256_add_epi32(sum, _mm256_madd_epi16(hi, hi));
+}
+
+//fold the two halves together then add up the four lanes that are left
+SSD_TARGET("avx2")
+static inline Uint32 lanesAVX2(__m256i sum)
+{
+	__m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+	half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+	half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (Uint32) _mm_cvtsi128_si32(half);
+}
+
+SSD_TARGET("avx2")
+static Uint64 ssdAVX2(const Uint8 *a, const Uint8 *b, int n)
+{
+	Uint64 total = 0;
+	for(int block = 0; block < n; block += SSD_BLOCK)
+	{
+		int end = MIN(n, block + SSD_BLOCK);
+		__m256i sum = _mm256_setzero_si256();
+		for(int i = block; i < end; i += 32)
+			sum = stepAVX2(sum, a + i, b + i);
+		total += lanesAVX2(sum);
+	}
+	return total;
+}
+
+SSD_TARGET("avx2")
+static Uint64 ssdBoundedAVX2(const Uint8 *a, const Uint8 *b, int n, Uint64 bound)
+{
+	Uint64 total = 0;
+	for(int chunk = 0; chunk < n && total <= bound; chunk += SSD_BOUND_CHUNK)
+	{
+		int end = MIN(n, chunk + SSD_BOUND_CHUNK);
+		__m256i sum = _mm256_setzero_si256();
+		for(int i = chunk; i < end; i += 32)
+			sum = stepAVX2(sum, a + i, b + i);
+		total += lanesAVX2(sum);
+	}
+	return total;
+}
+
+template <int N, int CHUNK>
+SSD_TARGET("avx2")
+static Uint64 ssdFixedAVX2(const Uint8 *a, const Uint8 *b, int, Uint64 bound)
+{
+	Uint64 total = 0;
+	for(int chunk = 0; chunk < N && total <= bound; chunk += CHUNK)
+	{
+		__m256i sum = _mm256_setzero_si256();
+		for(int i = chunk; i < chunk + CHUNK; i += 32)
+			sum = stepAVX2(sum, a + i, b + i);
+		total += lanesAVX2(sum);
+	}
+	return total;
+}
+
+SSD_TARGET("avx512f,avx512bw")
+static inline __m512i stepAVX512(__m512i sum, const Uint8 *a, const Uint8 *b)
+{
+	__m512i zero = _mm512_setzero_si512();
+	__m512i va = _mm512_load_si512((const void*)a);
+	__m512i vb = _mm512_load_si512((const void*)b);
+
+	__m512i d = _mm512_or_si512(_mm512_subs_epu8(va, vb), _mm512_subs_epu8(vb, va));
+	__m512i lo = _mm512_unpacklo_epi8(d, zero);
+	__m512i hi = _mm512_unpackhi_epi8(d, zero);
+	sum = _mm512_add_epi32(sum, _mm512_madd_epi16(lo, lo));
+	return _mm512_add_epi32(sum, _mm512_madd_epi16(hi, hi));
+}
+
+//fold the two halves together and add up the eight lanes that are left like the avx2 version.
+//the bounded kernel does this after every chunk, so it never goes through memory. (the
+//maskz extracts are the same as the plain ones, which some compilers warn about.)
+SSD_TARGET("avx512f,avx512bw")
+static inline Uint32 lanesAVX512(__m512i sum)
+{
+	return lanesAVX2(_mm256_add_epi32(_mm512_maskz_extracti64x4_epi64(0xff, sum, 0), _mm512_maskz_extracti64x4_epi64(0xff, sum, 1)));
+}
+
+SSD_TARGET("avx512f,avx512bw")
+static Uint64 ssdAVX512(const Uint8 *a, const Uint8 *b, int n)
+{
+	Uint64 total = 0;
+	for(int block = 0; block < n; block += SSD_BLOCK)
+	{
+		int end = MIN(n, block + SSD_BLOCK);
+		__m512i sum = _mm512_setzero_si512();
+		for(int i = block; i < end; i += 64)
+			sum = stepAVX512(sum, a + i, b + i);
+		total += lanesAVX512(sum);
+	}
+	return total;
+}
+
+SSD_TARGET("avx512f,avx512bw")
+static Uint64 ssdBoundedAVX512(const Uint8 *a, const Uint8 *b, int n, Uint64 bound)
+{
+	Uint64 total = 0;
+	for(int chunk = 0; chunk < n && total <= bound; chunk += SSD_BOUND_CHUNK)
+	{
+		int end = MIN(n, chunk + SSD_BOUND_CHUNK);
+		__m512i sum = _mm512_setzero_si512();
+		for(int i = chunk; i < end; i += 64)
+			sum = stepAVX512(sum, a + i, b + i);
+		total += lanesAVX512(sum);
+	}
+	return total;
+}
+
+template <int N, int CHUNK>
+SSD_TARGET("avx512f,avx512bw")
+static Uint64 ssdFixedAVX512(const Uint8 *a, const Uint8 *b, int, Uint64 bound)
+{
+	Uint64 total = 0;
+	for(int chunk = 0; chunk < N && total <= bound; chunk += CHUNK)
+	{
+		__m512i sum = _mm512_setzero_si512();
+		for(int i = chunk; i < chunk + CHUNK; i += 64)
+			sum = stepAVX512(sum, a + i, b + i);
+		total += lanesAVX512(sum);
+	}
+	return total;
+}
+
+//cpu feature checks
+#ifdef __GNUC__
+static bool hasSSE2()	{ __builtin_cpu_init(); return __builtin_cpu_supports("sse2"); }
+static bool hasAVX2()	{ __builtin_cpu_init(); return __builtin_cpu_supports("avx2"); }
+static bool hasAVX512()	{ __builtin_cpu_init(); return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"); }
+#else
+//msvc doesn't have the builtins so ask cpuid directly. the os also has to save the
+//bigger registers on context switches, which is what xgetbv tells us.
+static bool hasSSE2()
+{
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+}
+static unsigned long long osSavedState()
+{
+	int info[4];
+	__cpuid(info, 1);
+	//OSXSAVE
+	if(!(info[2] & (1 << 27)))
+		return 0;
+	return _xgetbv(0);
+}
+static bool hasAVX2()
+{
+	int info[4];
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) && (osSavedState() & 0x6) == 0x6;
+}
+static bool hasAVX512()
+{
+	int info[4];
+	__cpuidex(info, 7, 0);
+	//AVX512F and AVX512BW
+	return (info[1] & (1 << 16)) && (info[1] & (1 << 30)) && (osSavedState() & 0xe6) == 0xe6;
+}
+#endif
+
+#endif // SSD_X86
+
+ssd_func ssd = ssdScalar;
+ssd_bounded_func ssdBounded = ssdBoundedScalar;
+
+//the fixed length kernels of the kind initSSD() picked, for SSD_ALIGN, 2 * SSD_ALIGN, ... bytes.
+//the bounded ones look at the bound after every chunk, the whole ones only at the end.
+#define SSD_FIXED_SIZES (SSD_FIXED_MAX / SSD_ALIGN)
+static ssd_bounded_func fixedKernels[SSD_FIXED_SIZES] = { ssdFixedScalar<SSD_ALIGN, SSD_BOUND_CHUNK>, ssdFixedScalar<2 * SSD_ALIGN, SSD_BOUND_CHUNK>, ssdFixedScalar<3 * SSD_ALIGN, SSD_BOUND_CHUNK>, ssdFixedScalar<4 * SSD_ALIGN, SSD_BOUND_CHUNK> };
+static ssd_bounded_func wholeKernels[SSD_FIXED_SIZES] = { ssdFixedScalar<SSD_ALIGN, SSD_ALIGN>, ssdFixedScalar<2 * SSD_ALIGN, 2 * SSD_ALIGN>, ssdFixedScalar<3 * SSD_ALIGN, 3 * SSD_ALIGN>, ssdFixedScalar<4 * SSD_ALIGN, 4 * SSD_ALIGN> };
+
+//fills in fixedKernels and wholeKernels with the ones of the kernel with the passed name
+#define SSD_SET_FIXED(kernel) \
+	{ \
+		fixedKernels[0] = kernel<SSD_ALIGN, SSD_BOUND_CHUNK>; fixedKernels[1] = kernel<2 * SSD_ALIGN, SSD_BOUND_CHUNK>; \
+		fixedKernels[2] = kernel<3 * SSD_ALIGN, SSD_BOUND_CHUNK>; fixedKernels[3] = kernel<4 * SSD_ALIGN, SSD_BOUND_CHUNK>; \
+		wholeKernels[0] = kernel<SSD_ALIGN, SSD_ALIGN>; wholeKernels[1] = kernel<2 * SSD_ALIGN, 2 * SSD_ALIGN>; \
+		wholeKernels[2] = kernel<3 * SSD_ALIGN, 3 * SSD_ALIGN>; wholeKernels[3] = kernel<4 * SSD_ALIGN, 4 * SSD_ALIGN>; \
+	}
+static void setFixedSSD(const char *name)
+{
+	if(strcmp(name, "scalar") == 0)
+		SSD_SET_FIXED(ssdFixedScalar)
+#ifdef SSD_X86
+	else if(strcmp(name, "sse2") == 0)
+		SSD_SET_FIXED(ssdFixedSSE2)
+	else if(strcmp(name, "avx2") == 0)
+		SSD_SET_FIXED(ssdFixedAVX2)
+	else if(strcmp(name, "avx512") == 0)
+		SSD_SET_FIXED(ssdFixedAVX512)
+#endif
+}
+
+ssd_bounded_func fixedBoundedSSD(int n)
+{
+	if(n <= 0 || n > SSD_FIXED_MAX || n % SSD_ALIGN != 0)
+		return ssdBounded;
+	return fixedKernels[n / SSD_ALIGN - 1];
+}
+
+ssd_bounded_func fixedSSD(int n)
+{
+	if(n <= 0 || n > SSD_FIXED_MAX || n % SSD_ALIGN != 0)
+		return ssdBounded;
+	return wholeKernels[n / SSD_ALIGN - 1];
+}
+
+ssd_func getSSD(const char *name)
+{
+	if(strcmp(name, "scalar") == 0)
+		return ssdScalar;
+#ifdef SSD_X86
+	if(strcmp(name, "sse2") == 0 && hasSSE2())
+		return ssdSSE2;
+	if(strcmp(name, "avx2") == 0 && hasAVX2())
+		return ssdAVX2;
+	if(strcmp(name, "avx512") == 0 && hasAVX512())
+		return ssdAVX512;
+#endif
+	return NULL;
+}
+
+ssd_bounded_func getBoundedSSD(const char *name)
+{
+	if(strcmp(name, "scalar") == 0)
+		return ssdBoundedScalar;
+#ifdef SSD_X86
+	if(strcmp(name, "sse2") == 0 && hasSSE2())
+		return ssdBoundedSSE2;
+	if(strcmp(name, "avx2") == 0 && hasAVX2())
+		return ssdBoundedAVX2;
+	if(strcmp(name, "avx512") == 0 && hasAVX512())
+		return ssdBoundedAVX512;
+#endif
+	return NULL;
+}
+
+const char *initSSD()
+{
+	//fastest first
+	const char *names[] = { "avx512", "avx2", "sse2", "scalar" };
+	for(int i = 0; i < 4; i++)
+	{
+		ssd_func f = getSSD(names[i]);
+		if(f)
+		{
+			ssd = f;
+			ssdBounded = getBoundedSSD(names[i]);
+			setFixedSSD(names[i]);
+			return names[i];
+		}
+	}
+	return "scalar";
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef SSD_H_INCLUDED
+#define SSD_H_INCLUDED
+
+/*
+ * This file contains the sum of squared differences kernels used to compare neighborhoods.
+ * There is a plain C++ version and SSE2, AVX2 and AVX-512 versions; initSSD() asks the
+ * cpu what it can do and points ssd and ssdBounded at the fastest one it supports. They all
+ * do the math in integers so every version gives exactly the same answer.
+ */
+
+#ifdef __APPLE__
+    #include <SDL/SDL.h>
+#else
+    #include <SDL.h>
+#endif
+#include "util.h"	//debug()
+
+//every kernel reads its arrays in chunks of this many bytes, so the arrays passed to them
+//must start on an SSD_ALIGN byte boundary and their length must be a multiple of SSD_ALIGN.
+#define SSD_ALIGN 64
+
+//returns the sum of squared differences between the first n values of a and b
+typedef Uint64 (*ssd_func)(const Uint8 *a, const Uint8 *b, int n);
+
+//the kernel picked by initSSD(). it starts off as the plain version.
+extern ssd_func ssd;
+
+//how many bytes the bounded kernels add up between looking at their bound. one chunk is
+//enough to rule out most neighborhoods, even the short ones of the small diameters.
+//it has to be a multiple of SSD_ALIGN.
+#define SSD_BOUND_CHUNK SSD_ALIGN
+
+//the same as an ssd_func, but it gives up as soon as the sum is more than bound and returns
+//what it had by then, which is more than bound too. a sum that stays <= bound is exact.
+//a search that only wants something as close as its best so far can pass that as the
+//bound and skip most of the neighborhoods that are nowhere near it.
+typedef Uint64 (*ssd_bounded_func)(const Uint8 *a, const Uint8 *b, int n, Uint64 bound);
+
+//the bounded kernel picked by initSSD(), the same kind as ssd
+extern ssd_bounded_func ssdBounded;
+
+//the longest neighborhood the fixed length kernels are made for. every padded stride up to
+//this (a multiple of SSD_ALIGN) has one, which covers the diameters up to about 23 on the
+//level being synthesized and their squares on the levels above it.
+#define SSD_FIXED_MAX (4 * SSD_ALIGN)
+
+//returns a bounded kernel of the kind initSSD() picked that only works on arrays exactly n
+//bytes long. it's built with n known, so its loop is unrolled. if there isn't one for n it
+//returns ssdBounded. a search that compares a lot of neighborhoods of the same stride should
+//get this once and use it for all of them.
+ssd_bounded_func fixedBoundedSSD(int n);
+
+//the same, but the kernel only looks at the bound once it's done, so it always adds up all n
+//bytes and gives the exact sum. stopping early costs a sum of the lanes after every chunk and a
+//branch that's hard to predict, which is more than it saves when most comparisons are short
+//or go all the way anyway, like the exhaustive search's. if there isn't one for n it returns
+//ssdBounded.
+ssd_bounded_func fixedSSD(int n);
+
+//figures out the fastest kernel this cpu can run, points ssd at it and returns its name.
+//the kernels are shared by everything in the program, so call this once when it starts,
+//before any synthesis is running.
+const char *initSSD();
+
+//returns the kernel (or bounded kernel) with the passed name ("scalar", "sse2", "avx2", or
+//"avx512") or NULL if there is no such kernel or this cpu can't run it
+ssd_func getSSD(const char *name);
+ssd_bounded_func getBoundedSSD(const char *name);
+
+#endif // SSD_H_INCLUDED
@@ -19,280 +19,1005 @@
 
 #include "tex_syn.h"
 
-int TEX_SYN_THREADS = 22;
-float TEX_SYN_RED_WEIGHT = 0.85;
-float TEX_SYN_GREEN_WEIGHT = 1.0;
-float TEX_SYN_BLUE_WEIGHT = 0.6;
+//the default of tex_syn_params::coarseTermsMemory
+#define TEX_SYN_COARSE_TERMS_MEMORY (64 << 20)
+//the radius of the blur every level above the finest gets once it's synthesized
+#define TEX_SYN_LEVEL_BLUR 4
+
+tex_syn_params::tex_syn_params()
+{
+	diameter = 7;
+#ifdef TEX_SYN_USE_MULTIRESOLUTION
+	multiresolution = true;
+#else
+	multiresolution = false;
+#endif
+#ifdef TEX_SYN_WEIGHTED_COLORS
+	weightedColors = true;
+#else
+	weightedColors = false;
+#endif
+	redWeight = 0.85;
+	greenWeight = 1.0;
+	blueWeight = 0.6;
+	search = TEX_SYN_SEARCH_EXHAUSTIVE;
+	tsvqDepth = 12;
+	kcoherenceK = 4;
+	kcoherenceCache = NULL;
+	analysisCache = NULL;
+
+	threads = 4;
+	tsvqLeaves = 4;
+	patchmatchIterations = 5;
+	patchmatchRadius = 0;
+	parallelPasses = 2;
+	parallelJitter = 1.0;
+	order = TEX_SYN_ORDER_SCANLINE;
+	edges = TEX_SYN_EDGES_WRAP;
+	coarseTermsMemory = TEX_SYN_COARSE_TERMS_MEMORY;
+	seed = 0;
+	progress = NULL;
+	progressData = NULL;
+}
 
 
 //this function determines how similar the two passed neighborhoods are by using
-//a sum squared of difference
-double match(hood *one, hood * two)
+//a sum squared of difference. both are the unpacked channels of neighborhoods that are
+//stride bytes long once they are padded. the color weights are already folded into the
+//channels (see hood_settings) so this is just the ssd kernel picked for this cpu.
+//once the sum is more than bound it stops and returns something more than bound (see ssdBounded()).
+//compare is the kernel to use, the loops that compare a lot of neighborhoods of the same stride
+//look up fixedBoundedSSD() once and pass it in.
+inline Uint64 match(const Uint8 *one, const Uint8 *two, int stride, Uint64 bound = ~(Uint64)0, ssd_bounded_func compare = ssdBounded)
 {
-	if(one->getColors() != two->getColors())
-		verboseDebug("WARNING! these two neighborhoods don't have the same number of colors!\n");
-
-	double sum = 0.0;
-	for(int i=0; i < MIN( one->getColors(), two->getColors() ); i++)
-	{
-	    /* bad version
-	    double oneC = (double)one->getColor(i);
-	    double twoC = (double)two->getColor(i);
-	    sum += pow( oneC - twoC, 2.0);
-	    */
-
-	    SDL_Surface *oneFormat = one->getFormatSurface();
-	    SDL_Surface *twoFormat = two->getFormatSurface();
-		Uint8 red1 = 0;
-		Uint8 green1 = 0;
-		Uint8 blue1 = 0;
-		Uint8 red2 = 0;
-		Uint8 green2 = 0;
-		Uint8 blue2 = 0;
-		SDL_LockSurface(oneFormat);
-		SDL_GetRGB(one->getColor(i), oneFormat->format, &red1, &green1, &blue1);
-		SDL_UnlockSurface(oneFormat);
-		SDL_LockSurface(twoFormat);
-		SDL_GetRGB(two->getColor(i), twoFormat->format, &red2, &green2, &blue2);
-		SDL_UnlockSurface(twoFormat);
+	return compare(one, two, stride, bound);
+}
 
-#ifdef TEX_SYN_WEIGHTED_COLORS
-		sum += (pow( double(red1) - double(red2), 2.0) * TEX_SYN_RED_WEIGHT);
-		sum += (pow( double(green1) - double(green2), 2.0) * TEX_SYN_GREEN_WEIGHT);
-		sum += (pow( double(blue1) - double(blue2), 2.0) * TEX_SYN_BLUE_WEIGHT);
+//the closest distance any task of a search has found so far, shared by all of them without
+//a lock. it only ever goes down and a task that reads an older value just gives up on fewer
+//neighborhoods, so it doesn't matter when the others see a new one, only that every read and
+//write of it is atomic. it's 32 bits so that's one plain instruction on every cpu;
+//SHARED_BOUND_NONE means there isn't one yet (or it's too far to be worth sharing).
+typedef Uint32 shared_bound;
+#define SHARED_BOUND_NONE 0xffffffffu
+#ifdef _MSC_VER
+	#include <intrin.h>
+	//msvc makes an aligned volatile load atomic. the bound doesn't guard any other data, so
+	//it doesn't need a fence either.
+	#define loadBound(p) (*(const volatile Uint32*)(p))
+	//both return what *p was before
+	#define compareAndSwap(p, old, value) ((Uint32)_InterlockedCompareExchange((volatile long*)(p), (long)(value), (long)(old)))
 #else
-		sum += pow( double(red1) - double(red2), 2.0);
-		sum += pow( double(green1) - double(green2), 2.0);
-		sum += pow( double(blue1) - double(blue2), 2.0);
+	#define loadBound(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+	inline Uint32 compareAndSwap(shared_bound *p, Uint32 old, Uint32 value)
+	{
+		__atomic_compare_exchange_n(p, &old, value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+		return old;
+	}
 #endif
+
+inline Uint64 readBound(const shared_bound *bound)
+{
+	Uint32 b = loadBound(bound);
+	return (b == SHARED_BOUND_NONE) ? ~(Uint64)0 : b;
+}
+
+//lowers *bound to d if d is closer
+inline void lowerBound(shared_bound *bound, Uint64 d)
+{
+	if(d >= SHARED_BOUND_NONE)
+		return;
+	Uint32 seen = loadBound(bound);
+	while(d < seen)
+	{
+		//if another task got in first, try again against what it put there
+		Uint32 was = compareAndSwap(bound, seen, (Uint32)d);
+		if(was == seen)
+			break;
+		seen = was;
 	}
-	return sum;
 }
 
+//the best match a task found: how far it is and which input pixel (y * width + x) it is,
+//or -1 if the task didn't have any rows
+struct task_best
+{
+	Uint64 match;
+	int position;
+};
+
+//with multiresolution neighborhoods, the colors an output neighborhood takes from the coarser
+//levels only depend on which pixel of the next level up (x, y) is scaled onto, so every output
+//pixel under that parent compares the same coarse colors against every input neighborhood.
+//the exhaustive search splits the distance into that coarse term and the term of the level
+//itself and keeps the coarse terms to every input neighborhood for the parents of the rows
+//being synthesized, so the other pixels under a parent only compare their own level.
+struct coarse_terms
+{
+	//where the coarse colors start in a neighborhood (see hood::coarseStart())
+	int start;
+	//how many input neighborhoods there are. the terms in slot s are [s * count, (s + 1) * count)
+	size_t count;
+	int slots;
+	vector<Uint64> terms;
+	//the parent whose terms are in each slot, -1 if there aren't any yet
+	vector<int> parentX, parentY;
+};
+
+//returns the coarse terms for output pixel (x, y) of level curLevel. if the ones of its parent
+//aren't kept, the slot they go in is handed over and *fill is set; then the search has to work
+//them out as it goes.
+Uint64 *coarseTermsFor(coarse_terms *coarse, int curLevel, int x, int y, bool *fill)
+{
+	//the same way hood::gather() finds (x, y) on the coarser levels
+	int px = hood::levelPosition(curLevel, curLevel + 1, x), py = hood::levelPosition(curLevel, curLevel + 1, y);
+	int s = px % coarse->slots;
+	*fill = coarse->parentX[s] != px || coarse->parentY[s] != py;
+	coarse->parentX[s] = px;
+	coarse->parentY[s] = py;
+	return &coarse->terms[s * coarse->count];
+}
+
+//everything the search tasks need to know about the pixel that is being searched for.
+//one of these is shared by all the tasks of a search, each task works out which rows
+//are its own from its index.
 struct threadData
 {
-    threadData(int by, int ey, int w, int curLevel, SDL_mutex *mut, hood *outHood, hood_pyramid *inHoodPyramid, gauss_pyramid *inPyramid, hood *bestHood, double *lastMatch, Uint32 *color, int *bestX, int *bestY)
+    threadData(int numTasks, int w, int h, int curLevel, shared_bound *bound, const Uint8 *target, int targetStride, hood_pyramid *inHoodPyramid, const Uint64 *distances, Uint64 *coarse, bool fillCoarse, int coarseStart, task_best *best)
     {
-        this->by = by;
-        this->ey = ey;
+        this->numTasks = numTasks;
         this->w = w;
+        this->h = h;
         this->curLevel = curLevel;
-        this->mut = mut;
-        this->outHood = outHood;
+        this->bound = bound;
+        this->target = target;
+        this->targetStride = targetStride;
         this->inHoodPyramid = inHoodPyramid;
-        this->inPyramid = inPyramid;
-        this->bestHood = bestHood;
-        this->lastMatch = lastMatch;
-        this->color = color;
-        this->bestX = bestX;
-        this->bestY = bestY;
+        this->distances = distances;
+        this->coarse = coarse;
+        this->fillCoarse = fillCoarse;
+        this->coarseStart = coarseStart;
+        this->best = best;
     }
-    int by, ey, w, curLevel;
-    SDL_mutex *mut;
-    hood *outHood;
+    int numTasks, w, h, curLevel;
+    shared_bound *bound;
+    const Uint8 *target;
+    int targetStride;
     hood_pyramid *inHoodPyramid;
-    gauss_pyramid *inPyramid;
-    hood *bestHood;
-    double *lastMatch;
-    Uint32 *color;
-    int *bestX, *bestY;
+    const Uint64 *distances;
+    Uint64 *coarse;
+    bool fillCoarse;
+    int coarseStart;
+    //one per task, every task only writes its own
+    task_best *best;
 };
 
-//compares the neighborhoods of the input pyramid for rows [by, ey)
-void checkRows(int by, int ey, int w, int curLevel, SDL_mutex *mut, hood *outHood, hood_pyramid *inHoodPyramid, gauss_pyramid *inPyramid, hood *bestHood, double *bestMatch, Uint32 *color, int *bestX, int *bestY)
+//compares the neighborhoods of the input pyramid for rows [by, ey). if distances isn't NULL
+//it already holds the distance to every input neighborhood (see fft_search) and is used instead.
+//target is the output neighborhood, padded out to targetStride bytes.
+//if coarse isn't NULL it's the coarse terms of the distance to every input neighborhood, the
+//colors from coarseStart on are left out of the comparisons and those are added instead. if
+//fillCoarse is true they aren't known yet, so they are worked out and put there first.
+//the closest one is put in *best, if there's a tie it's the first one in scanline order.
+//bound is shared with the other tasks, see shared_bound.
+void checkRows(int by, int ey, int w, int curLevel, shared_bound *bound, const Uint8 *target, int targetStride, hood_pyramid *inHoodPyramid, const Uint64 *distances, Uint64 *coarse, bool fillCoarse, int coarseStart, task_best *best)
 {
-	hood *threadBestHood = NULL;
-	double threadBestMatch = 99999999.9;
-	Uint32 threadColor = 0;
-	int threadBestX = 0, threadBestY = 0;
+	Uint64 threadBestMatch = ~(Uint64)0;
+	int threadBestPosition = -1;
+
+	//the neighborhoods of a level are stored one after the other in scanline order
+	//so just walk straight through them
+	int stride = inHoodPyramid->getStride(curLevel);
+	if(targetStride != stride)
+		verboseDebug("WARNING! these two neighborhoods don't have the same number of colors!\n");
+	stride = MIN(stride, targetStride);
+	//the scan goes through every input neighborhood and most of them are short, so short ones
+	//are added up whole instead of stopping early (see fixedSSD())
+	ssd_bounded_func compare = fixedSSD(coarse ? coarseStart : stride);
+	ssd_bounded_func compareCoarse = fixedBoundedSSD(stride - coarseStart);
+	const Uint8 *outChannels = target;
+	const Uint8 *thisHood = inHoodPyramid->getHood(curLevel, 0, by);
+
     for(int sy = by; sy < ey; sy++)
     {
         //loop through the columns
-        for(int sx = 0; sx < w; sx++)
+        for(int sx = 0; sx < w; sx++, thisHood += stride)
         {
-            hood *thisHood = inHoodPyramid->getHood(curLevel, sx, sy);
-            //if there is not best hood
-            if(!threadBestHood)
+            Uint64 thisMatch;
+            if(distances)
+            	thisMatch = distances[sy * w + sx];
+            else if(coarse)
+            {
+            	//the coarse term has to be all there for the next pixels, only this level's stops early
+            	Uint64 *term = &coarse[sy * w + sx];
+            	if(fillCoarse)
+            		*term = compareCoarse(thisHood + coarseStart, outChannels + coarseStart, stride - coarseStart, ~(Uint64)0);
+            	Uint64 limit = MIN(threadBestMatch, readBound(bound));
+            	if(*term > limit)
+            		continue;
+            	thisMatch = *term + match(thisHood, outChannels, coarseStart, limit - *term, compare);
+            	if(thisMatch > limit)
+            		continue;
+            }
+            else
             {
-            	//assign a default value to the best hood
-            	threadBestHood = thisHood;
-            	//and the last match
-            	threadBestMatch = match(threadBestHood, outHood);
-				threadColor = getPixel(inPyramid->getLevel(curLevel), 0, 0);
-            	//skip the rest
-            	continue;
+            	//nothing farther than the closest any task has found can win, so stop adding up
+            	//the differences as soon as it is. one that's just as close could still win a
+            	//tie, it isn't given up on.
+            	Uint64 limit = MIN(threadBestMatch, readBound(bound));
+            	thisMatch = match(thisHood, outChannels, stride, limit, compare);
+            	if(thisMatch > limit)
+            		continue;
             }
-            double thisMatch = match(thisHood, outHood);
             if( thisMatch < threadBestMatch )
             {
-            	//found a better match, reset those values
-            	threadBestHood = thisHood;
+            	//found a better match, reset those values and let the other tasks know
             	threadBestMatch = thisMatch;
-            	threadBestX = sx;
-            	threadBestY = sy;
-            	threadColor = getPixel(inPyramid->getLevel(curLevel), sx, sy);
+            	threadBestPosition = sy * w + sx;
+            	lowerBound(bound, thisMatch);
             }
         }
     }
 
-    //now that this thread is done with its calculations, reset the master bestHood if it's better than this one
-    //do all this down here to cut down mutex lockings. like this, the worst case is that there will be
-    //TEX_SYN_THREADS locks to the mutex to write, old version was possible for it to be the area of the input
-    //image :-/
-    //use a while here in case there is a different thread with the mutex locked
-    while (threadBestMatch < *bestMatch)
+    //every task has its own spot for its best match, the one that ran the tasks merges
+    //them once they're all done (see mergeBest()). nothing has to be locked.
+    best->match = threadBestMatch;
+    best->position = threadBestPosition;
+}
+
+//returns the position of the best of the count task_best, -1 if none of them found anything.
+//ties go to the lower position, so it's the same as one task checking every row in order
+//no matter how the rows were split up or which task finished first.
+int mergeBest(const task_best *best, int count, Uint64 *bestMatch)
+{
+	int position = -1;
+	for(int t = 0; t < count; t++)
 	{
-		if (TEX_SYN_THREADS > 0)
+		if(best[t].position < 0)
+			continue;
+		if(position < 0 || best[t].match < *bestMatch || (best[t].match == *bestMatch && best[t].position < position))
 		{
-			//try to lock the mutex
-			if(SDL_mutexP(mut) != -1)
-			{
-				//success! reset all the master variables
-				bestHood = threadBestHood;
-				*bestMatch = threadBestMatch;
-				*bestX =  threadBestX;
-				*bestY = threadBestY;
-				*color = threadColor;
-				//unlock the mutex
-				SDL_mutexV(mut);
-			}
+			*bestMatch = best[t].match;
+			position = best[t].position;
 		}
-		else
-		{
-			//reset all the master variables
-			bestHood = threadBestHood;
-			*bestMatch = threadBestMatch;
-			*bestX =  threadBestX;
-			*bestY = threadBestY;
-			*color = threadColor;
-		}
-		//if the mutex lock failed, the values aren't set and it returns to the
-		//while() which will make the thread try to lock the mutex again.
-		//this will all continue until it gets the lock or another thread
-		//sets bestMatch to a value that is better than this thread's.
 	}
+	return position;
 }
 
-//all threads are initialized to run this function, it just takes the void* data type and breaks
-//everything out to run the standard version above.
-int threadCheckRows(void *data)
+//the worker pool runs this function for every task, it just takes the void* data type, figures out
+//which rows belong to task t and breaks everything out to run the standard version above.
+void threadCheckRows(int t, void *data)
 {
     //get it in a usable type
     threadData *dat = (threadData*) data;
-    checkRows(dat->by, dat->ey, dat->w, dat->curLevel, dat->mut, dat->outHood, dat->inHoodPyramid, dat->inPyramid, dat->bestHood, dat->lastMatch, dat->color, dat->bestX, dat->bestY);
 
-    //everything a ok
-    return 0;
+	//the rows are split up evenly, no two tasks get more than a row more or less than each other
+	int from = dat->h * t / dat->numTasks;
+	int to = dat->h * (t + 1) / dat->numTasks;
+	verboseDebug("\t\t\ttask #%d will check rows [%d, %d)\n", t, from, to);
+
+    checkRows(from, to, dat->w, dat->curLevel, dat->bound, dat->target, dat->targetStride, dat->inHoodPyramid, dat->distances, dat->coarse, dat->fillCoarse, dat->coarseStart, &dat->best[t]);
 }
 
-//a searching function used by textureSynthesis() to determine output pixel values
-//returns the color to assign that pixel
-Uint32 findBestMatch(hood_pyramid *inHoodPyramid, gauss_pyramid *inPyramid, gauss_pyramid *outPyramid, int curLevel, int x, int y)
+//what the worker pool needs to build the tsvq trees, one task per level
+struct treeData
 {
-	verboseDebug("\t\t\tBuilding output position neighborhood\n");
-	hood *outHood = new hood(outPyramid, curLevel, x, y);
+	hood_pyramid *inHoodPyramid;
+	tsvq **trees;
+	int depth;
+};
+
+//builds the tsvq tree for level l
+void buildTree(int l, void *data)
+{
+	treeData *dat = (treeData*) data;
+	//it might have come from the analysis cache
+	if(!dat->trees[l])
+		dat->trees[l] = new tsvq(dat->inHoodPyramid, l, dat->depth);
+}
+
+//everything findBestMatch() needs that stays the same for the whole synthesis
+struct searchData
+{
+	//the threads that split up exhaustive searches
+	worker_pool *pool;
+
+	//the params that matter here
+	int search, tsvqLeaves, edges;
+
+	const hood_settings *settings;
+	gauss_pyramid *inPyramid, *outPyramid;
+	hood_pyramid *inHoodPyramid;
+
+	//the tsvq tree of every level if search is TEX_SYN_SEARCH_TSVQ
+	tsvq **trees;
+
+	//for every level of the output pyramid, the index (y * width + x) of the input pixel
+	//that each output pixel was copied from, or -1 if it hasn't been synthesized yet
+	int **sources;
+
+	//hood::causalOffsets() of every level
+	vector<int> *causalX, *causalY;
+
+	//the k most similar pixels of every input pixel if search is TEX_SYN_SEARCH_KCOHERENCE
+	similarity_sets *similar;
+
+	//the fft search of every level, room for the distances it finds and for its work
+	//if search is TEX_SYN_SEARCH_FFT
+	fft_search **ffts;
+	Uint64 *distances;
+	fft_search::buffers *fftBuffers;
+
+	//the coarse terms of the level being synthesized in scanline order, or NULL if they aren't
+	//kept (see coarse_terms)
+	coarse_terms *coarse;
+};
+
+//what the searches are called on the command line, in TEX_SYN_SEARCH_* order
+static const char *searchNames[TEX_SYN_SEARCHES] = { "exhaustive", "tsvq", "coherence", "kcoherence", "patchmatch", "fft", "parallel" };
+
+int searchNamed(const char *name)
+{
+	for(int i = 0; i < TEX_SYN_SEARCHES; i++)
+		if(strcmp(name, searchNames[i]) == 0)
+			return i;
+	return -1;
+}
+
+const char *searchName(int search)
+{
+	return (search >= 0 && search < TEX_SYN_SEARCHES) ? searchNames[search] : "unknown";
+}
+
+//hands level to the params' progress callback, if there is one
+inline void reportProgress(const tex_syn_params &params, SDL_Surface *level)
+{
+	if(params.progress)
+		params.progress(level, params.progressData);
+}
+
+//adds the input neighborhood index i to candidates if it isn't there already
+inline void addCandidate(vector<int> &candidates, int i)
+{
+	for(int c = 0; c < candidates.size(); c++)
+		if(candidates[c] == i)
+			return;
+	candidates.push_back(i);
+}
+
+//fills in Ashikhmin's coherence candidates for (x, y) on level curLevel: for every neighbor
+//that is already synthesized, the input pixel it came from shifted back by the offset
+//between it and (x, y). that way the patch the neighbor was copied from can keep on going.
+//sources is where every pixel of the output level came from, or -1.
+void coherenceCandidates(searchData *search, int curLevel, const image_view<int> &sources, int x, int y, vector<int> &candidates)
+{
+	SDL_Surface *inLevel = search->inPyramid->getLevel(curLevel);
+	int inW = inLevel->w, inH = inLevel->h;
+	int outW = sources.getWidth(), outH = sources.getHeight();
+	vector<int> &xOffsets = search->causalX[curLevel];
+	vector<int> &yOffsets = search->causalY[curLevel];
+
+	candidates.clear();
+	for(int i = 0; i < xOffsets.size(); i++)
+	{
+		//the neighbor wraps around (or stops at) the edges of the output just like its neighborhood does
+		int nx = x + xOffsets[i], ny = y + yOffsets[i];
+		if(search->edges == TEX_SYN_EDGES_WRAP)
+		{
+			nx = wrapCoordinate(nx, outW);
+			ny = wrapCoordinate(ny, outH);
+		}
+		else
+		{
+			nx = clampCoordinate(nx, outW);
+			ny = clampCoordinate(ny, outH);
+		}
+		int source = sources.at(nx, ny);
+		if(source < 0)
+			continue;
+
+		//step back from where the neighbor came from, wrapping around the input too
+		int sx = wrapCoordinate(source % inW - xOffsets[i], inW);
+		int sy = wrapCoordinate(source / inW - yOffsets[i], inH);
+		addCandidate(candidates, sy * inW + sx);
+	}
+}
+
+//fills in the k-coherence candidates for (x, y) on level curLevel: every coherence candidate
+//plus the k input pixels whose neighborhoods are the most like each of theirs
+void kCoherenceCandidates(searchData *search, int curLevel, const image_view<int> &sources, int x, int y, vector<int> &candidates)
+{
+	coherenceCandidates(search, curLevel, sources, x, y, candidates);
+
+	int coherent = candidates.size(), k = search->similar->getK();
+	for(int c = 0; c < coherent; c++)
+	{
+		const int *set = search->similar->getSet(curLevel, candidates[c]);
+		for(int n = 0; n < k; n++)
+			if(set[n] >= 0)
+				addCandidate(candidates, set[n]);
+	}
+}
 
+//finds the input pixel on level curLevel whose neighborhood is the most like target, which is an
+//output neighborhood padded out to stride bytes. if candidates isn't empty only those input pixels
+//are tried. an exhaustive search is split up into row ranges that are handed to the worker pool,
+//unless split is false. then the whole search is done in the calling thread (the wavefront order
+//runs a lot of them at once from the pool's threads).
+//coarse and fillCoarse are the coarse terms of target's parent for the exhaustive search, if
+//they're kept (see coarseTermsFor()).
+//sets (*srcX, *srcY) to the input pixel that was picked and returns the color to assign that pixel
+Uint32 matchNeighborhood(searchData *search, int curLevel, const Uint8 *target, int stride, const vector<int> &candidates, int *srcX, int *srcY, bool split, Uint64 *coarse = NULL, bool fillCoarse = false)
+{
 	//best match stuff
-	hood *bestHood = NULL;
-	double lastMatch = 999999999.9;
+	Uint64 lastMatch = ~(Uint64)0;
 	Uint32 color = 0;
 	int bestX = 0, bestY = 0;
 
 	//others
-	int w = inPyramid->getLevel(curLevel)->w, h = inPyramid->getLevel(curLevel)->h;
+	SDL_Surface *inLevel = search->inPyramid->getLevel(curLevel);
+	int w = inLevel->w, h = inLevel->h;
 
 	verboseDebug("\t\t\tComparing neighborhoods\n");
-    //Start with the multithreading stuff
-	if (TEX_SYN_THREADS > 0)
+	if(search->search == TEX_SYN_SEARCH_TSVQ)
+	{
+		//the tree only compares a handful of neighborhoods, not worth splitting up
+		int best = search->trees[curLevel]->search(target, search->tsvqLeaves, &lastMatch);
+		bestX = best % w;
+		bestY = best / w;
+		color = getPixel(inLevel, bestX, bestY);
+	}
+	else if(!candidates.empty())
+	{
+		const Uint8 *inData = search->inHoodPyramid->getLevelData(curLevel);
+		int inStride = search->inHoodPyramid->getStride(curLevel);
+		ssd_bounded_func compare = fixedBoundedSSD(inStride);
+		int best = -1;
+		for(int c = 0; c < candidates.size(); c++)
+		{
+			Uint64 thisMatch = match(inData + (size_t)candidates[c] * inStride, target, inStride, lastMatch, compare);
+			//ties go to the earlier position so the order of the candidates doesn't matter
+			if(thisMatch < lastMatch || (thisMatch == lastMatch && candidates[c] < best))
+			{
+				lastMatch = thisMatch;
+				best = candidates[c];
+			}
+		}
+		bestX = best % w;
+		bestY = best / w;
+		color = getPixel(inLevel, bestX, bestY);
+	}
+	else
 	{
-		SDL_mutex *mut = SDL_CreateMutex();
+		//the fft search finds the distance to every input neighborhood at once,
+		//then the tasks only have to find the smallest one
+		const Uint64 *distances = NULL;
+		if(search->search == TEX_SYN_SEARCH_FFT && search->ffts[curLevel]->isUsable())
+		{
+			search->ffts[curLevel]->distances(target, search->distances, search->pool, search->fftBuffers);
+			distances = search->distances;
+		}
+
+		//one task for every thread and the one that's calling, but no more than there are rows
+		int numTasks = split ? search->pool->getThreads() + 1 : 1;
+		if(numTasks > h) numTasks = h;
+		if(numTasks < 1) numTasks = 1;
+
+		vector<task_best> best(numTasks);
+		shared_bound bound = SHARED_BOUND_NONE;
+		int coarseStart = coarse ? search->coarse->start : stride;
+		threadData dat(numTasks, w, h, curLevel, &bound, target, stride, search->inHoodPyramid, distances, distances ? NULL : coarse, fillCoarse, coarseStart, &best[0]);
+		if(split)
+			search->pool->run(threadCheckRows, (void*)&dat, numTasks);
+		else
+			threadCheckRows(0, (void*)&dat);
+
+		int position = mergeBest(&best[0], numTasks, &lastMatch);
+		bestX = position % w;
+		bestY = position / w;
+		color = getPixel(inLevel, bestX, bestY);
+	}
+
+	verboseDebug("\t\t\t\tBest match was %x at (%d, %d)\n", color, bestX, bestY);
+	*srcX = bestX;
+	*srcY = bestY;
+	return color;
+}
+
+//fills in the coherence candidates the search tries for (x, y) on level curLevel, if it uses them.
+//if there aren't any (like for the first pixel) the search falls back on comparing everything.
+void searchCandidates(searchData *search, int curLevel, const image_view<int> &sources, int x, int y, vector<int> &candidates)
+{
+	candidates.clear();
+	if(search->search == TEX_SYN_SEARCH_COHERENCE)
+		coherenceCandidates(search, curLevel, sources, x, y, candidates);
+	else if(search->search == TEX_SYN_SEARCH_KCOHERENCE)
+		kCoherenceCandidates(search, curLevel, sources, x, y, candidates);
+}
+
+//a searching function used by textureSynthesis() to determine output pixel values.
+//the output neighborhood is built in window, which the caller keeps for the whole level (see
+//hood_window), and candidates is room for the search's candidates, so nothing is allocated here.
+//split is the same as for matchNeighborhood().
+//sets (*srcX, *srcY) to the input pixel that was picked and returns the color to assign that pixel
+Uint32 findBestMatch(searchData *search, int curLevel, hood_window *window, vector<int> &candidates, int x, int y, int *srcX, int *srcY, bool split)
+{
+	verboseDebug("\t\t\tBuilding output position neighborhood\n");
+	const Uint8 *target = window->move(search->outPyramid, x, y);
 
-		//this is to make sure that no more than height threads are used
-		int numThreads = (TEX_SYN_THREADS <= h) ? TEX_SYN_THREADS : h;
+	SDL_Surface *outLevel = search->outPyramid->getLevel(curLevel);
+	searchCandidates(search, curLevel, image_view<int>(search->sources[curLevel], outLevel->w, outLevel->h, outLevel->w), x, y, candidates);
 
-		//calculate how many rows to give to each thread. the first threads get the floor of the division,
-		//the last one gets the remaining rows
-		int firstThreadsRows = floor(float(h) / numThreads);
+	//the wavefront order searches for a lot of pixels at once, they can't share the coarse terms
+	Uint64 *coarse = NULL;
+	bool fillCoarse = false;
+	if(search->coarse && split)
+		coarse = coarseTermsFor(search->coarse, curLevel, x, y, &fillCoarse);
 
-		//create the threads
-		SDL_Thread **threads = new SDL_Thread*[TEX_SYN_THREADS];
-		threadData **datas = new threadData*[TEX_SYN_THREADS];
-		for( int t = 0; t < numThreads; t++)
+	Uint32 color = matchNeighborhood(search, curLevel, target, window->getStride(), candidates, srcX, srcY, split, coarse, fillCoarse);
+
+	verboseDebug("\t\t\tDone\n");
+	return color;
+}
+
+//works out the wavefront for a w x h level l of the output, which has neighborhoods built with s
+//and edges that do what edges says. pixels can be synthesized at the same
+//time as long as none of them reads a pixel that another one writes, so every pixel has to come
+//after everything before it in scanline order that it reads or that reads it. steps[y * w + x]
+//is set to the first step pixel (x, y) can be done in and the number of steps is returned.
+//the order of the pixels that read each other doesn't change, so neither does the result.
+//only the colors of level l itself count, hood::gather() reads them around (x, y) and
+//the coarser levels are all synthesized before level l is started.
+int wavefrontSteps(const hood_settings *s, int w, int h, int l, int edges, vector<int> &steps)
+{
+	vector<int> xOffsets, yOffsets;
+	hood::offsets(s, l, xOffsets, yOffsets);
+
+	steps.assign(w * h, 0);
+	vector<int> reads(xOffsets.size());
+	int numSteps = 0;
+	for(int y = 0; y < h; y++)
+	{
+		for(int x = 0; x < w; x++)
 		{
-			//figure out what rows it needs to generate
-			int from = firstThreadsRows * t;
-			int to = firstThreadsRows * (t + 1);
-			if(t == numThreads)
+			int p = y * w + x;
+
+			//where this pixel's neighborhood ends up, the same way hood::gather() finds it
+			for(int i = 0; i < xOffsets.size(); i++)
 			{
-				from = firstThreadsRows * t;
-				to = h;
+				int nx = x + xOffsets[i], ny = y + yOffsets[i];
+				if(edges == TEX_SYN_EDGES_WRAP)
+				{
+					nx = wrapCoordinate(nx, w);
+					ny = wrapCoordinate(ny, h);
+				}
+				else
+				{
+					nx = clampCoordinate(nx, w);
+					ny = clampCoordinate(ny, h);
+				}
+				reads[i] = ny * w + nx;
 			}
-			verboseDebug("\t\t\tthread #%d will check rows [%d, %d)\n", t, from, to);
 
-			//create the data structure
-			datas[t] = new threadData(from, to, w, curLevel, mut, outHood, inHoodPyramid, inPyramid, bestHood, &lastMatch, &color, &bestX, &bestY);
-			//make the thread
-			threads[t] = SDL_CreateThread(threadCheckRows, (void*)datas[t]);
+			//after everything it reads that is synthesized before it...
+			for(int i = 0; i < reads.size(); i++)
+				if(reads[i] < p)
+					steps[p] = MAX(steps[p], steps[reads[i]] + 1);
+			//...and before everything it reads that isn't yet
+			for(int i = 0; i < reads.size(); i++)
+				if(reads[i] > p)
+					steps[reads[i]] = MAX(steps[reads[i]], steps[p] + 1);
+
+			numSteps = MAX(numSteps, steps[p] + 1);
 		}
+	}
+	return numSteps;
+}
 
-		//wait for them to finish
-		for(int t = 0; t<numThreads; t++)
-		{
-			int rs = 0;
-			SDL_WaitThread(threads[t], &rs);
+//what the wavefront tasks need. the pixels of a step are split up evenly between the tasks
+struct wavefrontData
+{
+	searchData *search;
+	int l;
+	SDL_Surface *curLevel;
+	//the count pixels (y * width + x) of this step
+	const int *pixels;
+	int count, numTasks;
+	//one window for every task, made once for the whole level
+	vector<hood_window*> windows;
+};
 
-			//my thread function will never return anything but 0 so this will never happen... I don't think anyway
-			if(rs != 0)
-				debug("WARNING: thread #%d returned status %d!\n", t, rs);
+//synthesizes task t's share of the pixels of a wavefront step. none of them read each other
+//so the window never gets to slide, and the last step wrote over what it had.
+void synthesizePixels(int t, void *data)
+{
+	wavefrontData *dat = (wavefrontData*) data;
+	searchData *search = dat->search;
+	int w = dat->curLevel->w;
+	hood_window &window = *dat->windows[t];
+	window.reset();
+	vector<int> candidates;
 
-			//delete the data it used
-			delete datas[t];
-		}
+	for(int i = dat->count * t / dat->numTasks; i < dat->count * (t + 1) / dat->numTasks; i++)
+	{
+		int p = dat->pixels[i];
+		int x = p % w, y = p / w;
 
-		//delete the threads and datas arrays
-		delete threads;
-		delete datas;
+		int srcX = 0, srcY = 0;
+		Uint32 color = findBestMatch(search, dat->l, &window, candidates, x, y, &srcX, &srcY, false);
 
-		//clean it up
-		SDL_DestroyMutex(mut);
+		surfaceView(dat->curLevel).at(x, y) = color | PIXEL_OPAQUE;
+		search->sources[dat->l][p] = srcY * search->inPyramid->getLevel(dat->l)->w + srcX;
 	}
+}
+
+//the similarity sets take a while to find, so they come from the analysis cache or kcoherenceCache
+//if they're there and are saved to kcoherenceCache if they aren't.
+similarity_sets *tex_syn_context::makeSimilaritySets(hood_pyramid *hoods, worker_pool *pool, analysis_cache *cached)
+{
+	similarity_sets *similar = cached ? cached->makeSimilaritySets(hoods, analysis.kcoherenceK) : NULL;
+	if(similar)
+		return similar;
+
+	similar = new similarity_sets(hoods, analysis.kcoherenceK);
+	if(analysis.kcoherenceCache && similar->load(analysis.kcoherenceCache))
+		debug("Loaded the similarity sets from %s\n", analysis.kcoherenceCache);
 	else
-		checkRows(0, h, w, curLevel, NULL, outHood, inHoodPyramid, inPyramid, bestHood, &lastMatch, &color, &bestX, &bestY);
+	{
+		debug("Finding the %d most similar neighborhoods of every input pixel\n", similar->getK());
+		similar->build(pool);
+		if(analysis.kcoherenceCache && similar->save(analysis.kcoherenceCache))
+			debug("Saved the similarity sets to %s\n", analysis.kcoherenceCache);
+	}
+	return similar;
+}
 
-	delete outHood;
-	verboseDebug("\t\t\t\tBest match was %x at (%d, %d)\n", color, bestX, bestY);
-	verboseDebug("\t\t\tDone\n");
-	return color;
+//an analysis cache file is only ever used for exactly what it was made for
+Uint64 tex_syn_context::analysisKey(SDL_Surface *input, float *weights)
+{
+	bool square = analysis.search == TEX_SYN_SEARCH_PARALLEL;
+	bool sets = analysis.search == TEX_SYN_SEARCH_KCOHERENCE || (square && analysis.kcoherenceK > 0);
+	int settings[] = { ANALYSIS_VERSION, input->w, input->h, levels, analysis.diameter, HOOD_ALIGN, square,
+		sets ? analysis.kcoherenceK : 0, (analysis.search == TEX_SYN_SEARCH_TSVQ) ? analysis.tsvqDepth : 0 };
+	Uint32 masks[] = { input->format->Rmask, input->format->Gmask, input->format->Bmask, input->format->Amask };
+
+	Uint64 key = analysis_cache::hash(ANALYSIS_HASH_START, settings, sizeof(settings));
+	key = analysis_cache::hash(key, masks, sizeof(masks));
+	key = analysis_cache::hash(key, weights, 3 * sizeof(float));
+	image_view<Uint32> pixels = surfaceView(input);
+	for(int y = 0; y < input->h; y++)
+		key = analysis_cache::hash(key, pixels.row(y), input->w * sizeof(Uint32));
+	return key;
+}
+
+int tex_syn_context::levelsFor(int w, int h)
+{
+	//the same number gauss_pyramid picks on its own
+	int t = 0;
+	for(int n = MIN(w, h); n > 1; n /= 2)
+		t++;
+	return MAX(t, 1);
+}
+
+tex_syn_context::tex_syn_context(SDL_Surface *input, int l, const tex_syn_params &params)
+{
+	analysis = params;
+	levels = params.multiresolution ? l : 1;
+
+	//fold the color weights into the neighborhoods
+	float weights[3] = { 1.0, 1.0, 1.0 };
+	if(params.weightedColors)
+	{
+		weights[0] = params.redWeight;
+		weights[1] = params.greenWeight;
+		weights[2] = params.blueWeight;
+	}
+	settings = new hood_settings(params.diameter, params.multiresolution, weights[0], weights[1], weights[2]);
+
+	//an earlier run might have saved the analysis of this input
+	cache = NULL;
+	if(params.analysisCache)
+	{
+		cache = new analysis_cache(params.analysisCache, analysisKey(input, weights));
+		if(cache->load())
+			debug("Using the analysis of the input saved in %s\n", cache->getFilename());
+	}
+	analysis_cache *cached = (cache && cache->isLoaded()) ? cache : NULL;
+
+	//the analysis gets its own threads, they are gone by the time anything is synthesized
+	worker_pool *pool = new worker_pool(params.threads);
+
+	debug("Making input texture Gaussian Pyramid\n");				//G_a
+	inPyramid = cached ? cached->makePyramid(input) : NULL;
+	if(!inPyramid)
+		inPyramid = new gauss_pyramid(input, levels, false, pool);
+	inHoodPyramid = cached ? cached->makeHoods(settings, inPyramid, false) : NULL;
+	if(!inHoodPyramid)
+		inHoodPyramid = new hood_pyramid(settings, inPyramid);
+
+	//build the search trees, the levels don't depend on each other so they are built in parallel
+	trees = NULL;
+	if(params.search == TEX_SYN_SEARCH_TSVQ)
+	{
+		debug("Building TSVQ trees of depth %d\n", params.tsvqDepth);
+		trees = new tsvq*[inPyramid->getLevels()];
+		for(int i = 0; i < inPyramid->getLevels(); i++)
+			trees[i] = cached ? cached->makeTree(inHoodPyramid, i) : NULL;
+		treeData dat;
+		dat.inHoodPyramid = inHoodPyramid;
+		dat.trees = trees;
+		dat.depth = params.tsvqDepth;
+		pool->run(buildTree, (void*)&dat, inPyramid->getLevels());
+	}
+
+	//the similarity sets for k-coherence
+	similar = NULL;
+	if(params.search == TEX_SYN_SEARCH_KCOHERENCE)
+		similar = makeSimilaritySets(inHoodPyramid, pool, cached);
+
+	//the parallel synthesis compares whole squares, so it needs its own neighborhoods and
+	//similarity sets made from them. k = 0 turns the similarity sets off.
+	squareHoodPyramid = NULL;
+	if(params.search == TEX_SYN_SEARCH_PARALLEL)
+	{
+		squareHoodPyramid = cached ? cached->makeHoods(settings, inPyramid, true) : NULL;
+		if(!squareHoodPyramid)
+			squareHoodPyramid = new hood_pyramid(settings, inPyramid, true);
+		if(params.kcoherenceK > 0)
+			similar = makeSimilaritySets(squareHoodPyramid, pool, cached);
+	}
+
+	//save all that for next time
+	if(cache && !cached && cache->save(inPyramid, inHoodPyramid, squareHoodPyramid, similar, trees))
+		debug("Saved the analysis of the input to %s\n", cache->getFilename());
+
+	//get the input levels ready for the fft search
+	ffts = NULL;
+	if(params.search == TEX_SYN_SEARCH_FFT)
+	{
+		debug("Transforming the input levels for the fft search\n");
+		ffts = new fft_search*[inPyramid->getLevels()];
+		for(int i = 0; i < inPyramid->getLevels(); i++)
+			ffts[i] = new fft_search(settings, inPyramid, i, pool);
+	}
+	delete pool;
+
+	//the neighbors the coherence searches look at
+	causalX = new vector<int>[levels];
+	causalY = new vector<int>[levels];
+	for(int i = 0; i < levels; i++)
+		hood::causalOffsets(settings, i, causalX[i], causalY[i]);
+}
+
+tex_syn_context::~tex_syn_context()
+{
+	delete[] causalX;
+	delete[] causalY;
+	delete similar;
+	if(ffts)
+	{
+		for(int i = 0; i < inPyramid->getLevels(); i++)
+			delete ffts[i];
+		delete[] ffts;
+	}
+	if(trees)
+	{
+		for(int i = 0; i < inPyramid->getLevels(); i++)
+			delete trees[i];
+		delete[] trees;
+	}
+	delete inHoodPyramid;
+	delete squareHoodPyramid;
+	delete inPyramid;
+	delete settings;
+	//after everything that might be using the mapped file
+	delete cache;
+}
+
+size_t tex_syn_context::getMemoryUse() const
+{
+	size_t total = 0;
+	for(int l = 0; l < inPyramid->getLevels(); l++)
+	{
+		SDL_Surface *level = inPyramid->getLevel(l);
+		size_t pixels = (size_t)level->w * level->h;
+		total += (size_t)level->pitch * level->h;
+		total += pixels * inHoodPyramid->getStride(l);
+		if(squareHoodPyramid)
+			total += pixels * squareHoodPyramid->getStride(l);
+		if(similar)
+			total += pixels * similar->getK() * sizeof(int);
+		if(trees)
+			total += trees[l]->getNodes() * (sizeof(tsvq::tsvq_node) + inHoodPyramid->getStride(l)) + pixels * sizeof(int);
+		if(ffts)
+			total += ffts[l]->getMemoryUse();
+	}
+	return total;
 }
 
-SDL_Surface *textureSynthesis(SDL_Surface *inputTexture, int w, int h)
+SDL_Surface *tex_syn_context::synthesize(int w, int h, const tex_syn_params &params) const
 {
+	if(levelsFor(w, h) < levels)
+	{
+		debug("ERROR: a %d x %d texture is too small for a pyramid %d levels tall\n", w, h, levels);
+		return NULL;
+	}
+
 	debug("Making output texture\n");						//I_s
-	SDL_Surface *outputTexture = createSurface(w, h);
+	SDL_Surface *input = inPyramid->getLevel(0);
+	SDL_Surface *outputTexture = createSurface(w, h, input->format);
 
 	debug("Generating noise on output texture\n");
-	noisify(outputTexture);
+	noisify(outputTexture, params.seed);
+
+	//the threads that compare neighborhoods are made once here and reused for every pixel
+	debug("Starting the worker pool\n");
+	worker_pool *pool = new worker_pool(params.threads);
 
 	debug("Making output texture Gaussian Pyramid\n");				//G_s
-	gauss_pyramid *outPyramid = new gauss_pyramid(outputTexture, -1, false);
+	gauss_pyramid *outPyramid = new gauss_pyramid(outputTexture, levels, false, pool);
 
-	debug("Making input texture Gaussian Pyramid\n");				//G_a
-	gauss_pyramid *inPyramid = new gauss_pyramid(inputTexture, outPyramid->getLevels());
-	hood_pyramid *inHoodPyramid = new hood_pyramid(inPyramid);
+	//where every output pixel came from, the coherence search needs to know
+	int **sources = new int*[levels];
+	for(int i = 0; i < levels; i++)
+	{
+		int size = outPyramid->getLevel(i)->w * outPyramid->getLevel(i)->h;
+		sources[i] = new int[size];
+		for(int j = 0; j < size; j++)
+			sources[i][j] = -1;
+	}
+
+	//room for the fft search to work in
+	Uint64 *distances = NULL;
+	fft_search::buffers fftBuffers;
+	if(ffts)
+		distances = new Uint64[input->w * input->h];
+
+	searchData search;
+	search.pool = pool;
+	search.search = analysis.search;
+	search.tsvqLeaves = params.tsvqLeaves;
+	search.edges = params.edges;
+	search.settings = settings;
+	search.inPyramid = inPyramid;
+	search.outPyramid = outPyramid;
+	search.inHoodPyramid = inHoodPyramid;
+	search.trees = trees;
+	search.sources = sources;
+	search.causalX = causalX;
+	search.causalY = causalY;
+	search.similar = similar;
+	search.ffts = ffts;
+	search.distances = distances;
+	search.fftBuffers = &fftBuffers;
+	search.coarse = NULL;
 
 	debug("Beginning texture synthesis...\n");
-	int l = 0;
 	double totTime = 0;
-#ifdef TEX_SYN_USE_MULTIRESOLUTION
-	for(l = outPyramid->getLevels() - 1; l >= 0; l--)
+	//--order=wavefront can't always be done, say so the first time it isn't
+	bool warnedOrder = false;
+	//without multiresolution there is only one level
+	for(int l = levels - 1; l >= 0; l--)
 	{
-#endif
 		SDL_Surface *curLevel = outPyramid->getLevel(l);
+		image_view<Uint32> curPixels = surfaceView(curLevel);
 		int lvlW = curLevel->w, lvlH = curLevel->h;
 		debug("\tBeginning work on %d x %d level %d of the output pyramid..\n", lvlW, lvlH, l);
 
-		//do this in scanline order
-		for(int y = 0; y < lvlH; y++)
+		//the coarse terms kept for the last level are gone with it
+		coarse_terms coarse;
+		search.coarse = NULL;
+
+		if(analysis.search == TEX_SYN_SEARCH_PARALLEL)
+		{
+			//upsample and jitter the coarser level's coordinates, then correct them
+			parallel_synthesis ps(inPyramid, squareHoodPyramid, outPyramid, l, sources[l], similar, randomKey(params.seed, RANDOM_PARALLEL, l));
+			ps.initialize((l + 1 < levels) ? sources[l + 1] : NULL, params.parallelJitter);
+			reportProgress(params, curLevel);
+			for(int i = 0; i < params.parallelPasses; i++)
+			{
+				clock_t start = clock();
+				ps.correct(pool, i);
+				reportProgress(params, curLevel);
+				debug("\t\tCorrection pass %d done in %f s*\n", i, ((double)clock() - start) / CLOCKS_PER_SEC);
+			}
+		}
+		else if(analysis.search == TEX_SYN_SEARCH_PATCHMATCH)
+		{
+			//the whole level is refined at once, starting from the coarser level's matches
+			patch_match pm(inPyramid, inHoodPyramid, outPyramid, l, sources[l], randomKey(params.seed, RANDOM_PATCHMATCH, l));
+			pm.initialize((l + 1 < levels) ? sources[l + 1] : NULL);
+			reportProgress(params, curLevel);
+			for(int i = 0; i < params.patchmatchIterations; i++)
+			{
+				clock_t start = clock();
+				pm.iterate(pool, i, params.patchmatchRadius);
+				reportProgress(params, curLevel);
+				debug("\t\tPatchMatch pass %d done in %f s*\n", i, ((double)clock() - start) / CLOCKS_PER_SEC);
+			}
+		}
+
+		//the other searches go through the level one pixel at a time
+		bool scanline = analysis.search != TEX_SYN_SEARCH_PATCHMATCH && analysis.search != TEX_SYN_SEARCH_PARALLEL;
+
+		//or a whole wavefront of pixels at a time, if they don't depend on each other
+		if(scanline && params.order == TEX_SYN_ORDER_WAVEFRONT)
+		{
+			vector<int> steps;
+			int numSteps = 0;
+			const char *fallback = NULL;
+			if(analysis.search == TEX_SYN_SEARCH_FFT)
+				fallback = "the fft search can only do one pixel at a time";
+			else if((numSteps = wavefrontSteps(settings, lvlW, lvlH, l, params.edges, steps)) >= lvlW * lvlH)
+				fallback = "every pixel depends on the one before it";
+
+			if(fallback)
+			{
+				debug("\t\tWavefront: %s, using the scanline order\n", fallback);
+				//a level of a pixel or two has no wavefront with clamped edges either, but with
+				//wrapped edges (the default) every level but the smallest ones falls back
+				if(!warnedOrder && (analysis.search == TEX_SYN_SEARCH_FFT || params.edges == TEX_SYN_EDGES_WRAP))
+				{
+					fprintf(stderr, "WARNING: --order=wavefront is using the scanline order from level %d on, %s%s\n", l, fallback,
+						analysis.search == TEX_SYN_SEARCH_FFT ? "" : " with --edges=wrap. Use --edges=clamp for a wavefront");
+					warnedOrder = true;
+				}
+			}
+			else
+			{
+				scanline = false;
+				debug("\t\tSynthesizing %d pixels in %d wavefront steps\n", lvlW * lvlH, numSteps);
+
+				//sort the pixels by step, the pixels of step s are [first[s], first[s + 1])
+				vector<int> first(numSteps + 1, 0), pixels(lvlW * lvlH);
+				for(int p = 0; p < lvlW * lvlH; p++)
+					first[steps[p] + 1]++;
+				for(int s = 0; s < numSteps; s++)
+					first[s + 1] += first[s];
+				vector<int> next(first.begin(), first.end() - 1);
+				for(int p = 0; p < lvlW * lvlH; p++)
+					pixels[next[steps[p]]++] = p;
+
+				wavefrontData dat;
+				dat.search = &search;
+				dat.l = l;
+				dat.curLevel = curLevel;
+				//one task for every thread and the one that's calling
+				for(int t = 0; t < pool->getThreads() + 1; t++)
+					dat.windows.push_back(new hood_window(settings, outPyramid, l, params.edges == TEX_SYN_EDGES_WRAP));
+
+				clock_t start = clock();
+				for(int s = 0; s < numSteps; s++)
+				{
+					dat.pixels = &pixels[first[s]];
+					dat.count = first[s + 1] - first[s];
+					dat.numTasks = MIN(dat.count, (int)dat.windows.size());
+					pool->run(synthesizePixels, (void*)&dat, dat.numTasks);
+					reportProgress(params, curLevel);
+				}
+				for(int t = 0; t < dat.windows.size(); t++)
+					delete dat.windows[t];
+				debug("\t\tWavefront done in %f s*\n", ((double)clock() - start) / CLOCKS_PER_SEC);
+			}
+		}
+
+		//the exhaustive search keeps the coarse terms of its distances if they can be compared on their own
+		if(scanline && analysis.search == TEX_SYN_SEARCH_EXHAUSTIVE && params.coarseTermsMemory > 0 && hood::splitsCoarse(settings, inPyramid, l))
+		{
+			coarse.start = hood::coarseStart(settings, inPyramid, l);
+			coarse.count = (size_t)inHoodPyramid->getWidth(l) * inHoodPyramid->getHeight(l);
+			coarse.slots = (int)MIN((size_t)lvlW, MAX((size_t)1, params.coarseTermsMemory / (coarse.count * sizeof(Uint64))));
+			coarse.terms.resize(coarse.slots * coarse.count);
+			coarse.parentX.assign(coarse.slots, -1);
+			coarse.parentY.assign(coarse.slots, -1);
+			search.coarse = &coarse;
+			debug("\t\tKeeping the coarse terms of %d parents\n", coarse.slots);
+		}
+
+		//do this in scanline order. the output neighborhood slides along each row in window
+		hood_window window(settings, outPyramid, l, params.edges == TEX_SYN_EDGES_WRAP);
+		vector<int> candidates;
+		for(int y = 0; y < lvlH && scanline; y++)
 		{
             //for timing the operation
             clock_t start = clock();
@@ -300,14 +1025,16 @@ SDL_Surface *textureSynthesis(SDL_Surface *inputTexture, int w, int h)
 			{
 				verboseDebug("\t\tCalculating color for level %d at (%d, %d)\n", l, x, y);
 
-				//update the display
-				dispSurface(curLevel);
+				//update the preview
+				reportProgress(params, curLevel);
 
 				//calculate the color to put here
-				Uint32 color = findBestMatch(inHoodPyramid, inPyramid, outPyramid, l, x, y);
+				int srcX = 0, srcY = 0;
+				Uint32 color = findBestMatch(&search, l, &window, candidates, x, y, &srcX, &srcY, true);
 
-				//put that color on the pyramid level
-				putPixel(curLevel, x, y, color);
+				//put that color on the pyramid level and remember where it came from
+				curPixels.at(x, y) = color | PIXEL_OPAQUE;
+				sources[l][y * lvlW + x] = srcY * inPyramid->getLevel(l)->w + srcX;
 			}
 			totTime += ((double)clock() - start) / CLOCKS_PER_SEC;
 			if(y % 20 == 0)
@@ -316,25 +1043,348 @@ SDL_Surface *textureSynthesis(SDL_Surface *inputTexture, int w, int h)
             	//consistant in time.
 		}
 
-#ifdef TEX_SYN_USE_MULTIRESOLUTION
 		//reset the timer every level
 		totTime = 0.0;
 
 		//blur the curent level (if it isn't the last)
 		if(l > 0)
-			gaussianBlur(curLevel);
+			gaussianBlur(curLevel, TEX_SYN_LEVEL_BLUR, pool);
 	}
-#endif
 
 	//reconstruct the pyramid
 	SDL_Surface *toReturn = outPyramid->reconstructPyramid();
 
 	//free output bitmap
 	debug("Cleaning up\n");
+	delete pool;
+	for(int i = 0; i < levels; i++)
+		delete[] sources[i];
+	delete[] sources;
+	delete[] distances;
 	delete outPyramid;
-	delete inHoodPyramid;
-	delete inPyramid;
 
 	//return it up.
 	return toReturn;
 }
+
+//the rows of one level of a stream. only the ones that are still going to be read are in
+//memory, the others point at none, a row that was never synthesized. the rows that are let
+//go of are put aside and used again for the next ones.
+template <typename T>
+struct stream_rows
+{
+	int w;
+	vector<T*> rows;
+	T *none;
+	vector<T*> spare;
+	//how many rows are in memory, and the most there ever were
+	int kept, peak;
+
+	void init(int width, int height, T *noRow)
+	{
+		w = width;
+		rows.assign(height, noRow);
+		none = noRow;
+		kept = peak = 0;
+	}
+
+	//puts row y in memory and returns it, it holds whatever the last row there did
+	T *keep(int y)
+	{
+		if(rows[y] != none)
+			return rows[y];
+		if(spare.empty())
+			spare.push_back(new T[w]);
+		rows[y] = spare.back();
+		spare.pop_back();
+		kept++;
+		peak = MAX(peak, kept);
+		return rows[y];
+	}
+
+	void drop(int y)
+	{
+		if(rows[y] == none)
+			return;
+		spare.push_back(rows[y]);
+		rows[y] = none;
+		kept--;
+	}
+
+	void release()
+	{
+		for(int y = 0; y < rows.size(); y++)
+			drop(y);
+		for(int i = 0; i < spare.size(); i++)
+			delete[] spare[i];
+		spare.clear();
+	}
+};
+
+//one level of a stream. synthesize() blurs every level above the finest once it's done and
+//the finer levels read the blurred one, so those are blurred a row at a time here too.
+struct stream_level
+{
+	int w, h;
+	stream_rows<Uint32> pixels, blurred;
+	stream_rows<int> sources;
+	//NULL on the finest level
+	row_blur *blur;
+
+	//how far above a pixel its neighborhood reaches on this level, and how far the
+	//neighborhoods of the finer levels reach above and below where they are on it
+	int reach, minY, maxY;
+	//with wrapped edges the first rows read the last ones before they're synthesized, so rows
+	//[tail, h) start out as noise and stay. the same goes for the blurred rows past blurredTail,
+	//and the finer levels' last rows read the blurred rows [0, head) long after they're done.
+	int head, tail, blurredTail;
+	//the next row to synthesize and to blur, and the first ones that haven't been let go of
+	int next, nextBlurred, first, firstBlurred;
+};
+
+bool tex_syn_context::stream(int w, int h, const tex_syn_params &params, const char *filename) const
+{
+	if(analysis.search == TEX_SYN_SEARCH_PATCHMATCH || analysis.search == TEX_SYN_SEARCH_PARALLEL)
+	{
+		debug("ERROR: the patchmatch and parallel searches need the whole output at once, they can't be streamed\n");
+		return false;
+	}
+	if(w < 1 || h < 1)
+	{
+		debug("ERROR: can't stream a %d x %d texture\n", w, h);
+		return false;
+	}
+	if(levelsFor(w, h) < levels)
+	{
+		debug("ERROR: a %d x %d texture is too small for a pyramid %d levels tall\n", w, h, levels);
+		return false;
+	}
+
+	FILE *out = fopen(filename, "wb");
+	if(!out)
+	{
+		debug("ERROR: couldn't open %s to stream the output to\n", filename);
+		return false;
+	}
+	fprintf(out, "P6\n%d %d\n255\n", w, h);
+	debug("Streaming a %d x %d texture to %s\n", w, h, filename);
+
+	//the pixels are laid out just like synthesize()'s output texture
+	SDL_Surface *input = inPyramid->getLevel(0);
+	SDL_Surface *like = createSurface(1, 1, input->format);
+	const SDL_PixelFormat *format = like->format;
+	bool wrap = params.edges == TEX_SYN_EDGES_WRAP;
+
+	//the rows that aren't kept
+	Uint32 *noPixels = new Uint32[w];
+	int *noSources = new int[w];
+	for(int x = 0; x < w; x++)
+	{
+		noPixels[x] = 0;
+		noSources[x] = -1;
+	}
+
+	//every level is half the size of the one below it, rounded up like gauss_pyramid's
+	vector<stream_level> pyramid(levels);
+	vector<image_view<Uint32> > pixels, blurred;
+	vector<image_view<int> > sources;
+	for(int l = 0; l < levels; l++)
+	{
+		stream_level &level = pyramid[l];
+		level.w = l ? (pyramid[l - 1].w + 1) / 2 : w;
+		level.h = l ? (pyramid[l - 1].h + 1) / 2 : h;
+		level.pixels.init(level.w, level.h, noPixels);
+		level.blurred.init(level.w, level.h, noPixels);
+		level.sources.init(level.w, level.h, noSources);
+		level.blur = l ? new row_blur(level.w, level.h, TEX_SYN_LEVEL_BLUR) : NULL;
+
+		vector<int> xOffsets, yOffsets;
+		hood::offsets(settings, l, xOffsets, yOffsets);
+		level.reach = 0;
+		for(int i = 0; i < yOffsets.size(); i++)
+			level.reach = MAX(level.reach, -yOffsets[i]);
+		const hood_stencil &square = settings->getStencil(l, false);
+		level.minY = l ? square.minY : 0;
+		level.maxY = l ? square.maxY : 0;
+
+		level.head = wrap ? MIN(level.maxY, level.h) : 0;
+		level.tail = wrap ? MAX(level.h - level.reach, 0) : level.h;
+		level.blurredTail = wrap ? MAX(level.h + level.minY, 0) : level.h;
+		level.next = level.nextBlurred = level.first = level.firstBlurred = 0;
+		for(int y = MIN(level.tail, level.blurredTail); y < level.h; y++)
+		{
+			Uint32 *row = level.pixels.keep(y);
+			noisifyRow(row, level.w, y, params.seed, format, l);
+			for(int x = 0; x < level.w; x++)
+				level.sources.keep(y)[x] = -1;
+			if(y >= level.blurredTail)
+				memcpy(level.blurred.keep(y), row, level.w * sizeof(Uint32));
+		}
+
+		pixels.push_back(image_view<Uint32>(&level.pixels.rows[0], level.w, level.h));
+		blurred.push_back(image_view<Uint32>(&level.blurred.rows[0], level.w, level.h));
+		sources.push_back(image_view<int>(&level.sources.rows[0], level.w, level.h));
+	}
+
+	worker_pool *pool = new worker_pool(params.threads);
+	Uint64 *distances = NULL;
+	fft_search::buffers fftBuffers;
+	if(ffts)
+		distances = new Uint64[input->w * input->h];
+
+	searchData search;
+	search.pool = pool;
+	search.search = analysis.search;
+	search.tsvqLeaves = params.tsvqLeaves;
+	search.edges = params.edges;
+	search.settings = settings;
+	search.inPyramid = inPyramid;
+	search.outPyramid = NULL;
+	search.inHoodPyramid = inHoodPyramid;
+	search.trees = trees;
+	search.sources = NULL;
+	search.causalX = causalX;
+	search.causalY = causalY;
+	search.similar = similar;
+	search.ffts = ffts;
+	search.distances = distances;
+	search.fftBuffers = &fftBuffers;
+	search.coarse = NULL;
+
+	//the output neighborhoods of every level slide along its rows straight out of the kept
+	//ones. the output pyramid is shaped like the input's, so they're padded like its are.
+	vector<hood_window*> windows;
+	for(int l = 0; l < levels; l++)
+		windows.push_back(new hood_window(settings, inPyramid, l, wrap));
+	vector<int> candidates, need(levels), needBlurred(levels);
+	Uint8 *rgb = new Uint8[w * 3];
+	bool ok = true;
+
+	debug("Beginning texture synthesis...\n");
+	double totTime = 0;
+	for(int y = 0; y < h && ok; y++)
+	{
+		clock_t start = clock();
+
+		//every level reads the blurred rows of all the ones above it around where it is on them,
+		//so a level has to be blurred as far down as the finer ones read it, and synthesized
+		//as far down as that blur reads
+		need[0] = y;
+		for(int l = 1; l < levels; l++)
+		{
+			needBlurred[l] = 0;
+			for(int f = 0; f < l; f++)
+				needBlurred[l] = MAX(needBlurred[l], hood::levelPosition(f, l, need[f]) + pyramid[l].maxY);
+			needBlurred[l] = MIN(needBlurred[l], pyramid[l].h - 1);
+			need[l] = MIN(needBlurred[l] + TEX_SYN_LEVEL_BLUR, pyramid[l].h - 1);
+		}
+
+		//the coarsest first, so everything a row reads is done before it is
+		for(int l = levels - 1; l >= 0; l--)
+		{
+			stream_level &level = pyramid[l];
+			while(true)
+			{
+				//blur every row that has all the rows it reads
+				for(; level.blur && level.nextBlurred <= needBlurred[l] && (level.nextBlurred + TEX_SYN_LEVEL_BLUR < level.next || level.next == level.h); level.nextBlurred++)
+					level.blur->get(level.nextBlurred, level.blurred.keep(level.nextBlurred), format);
+				if(level.next > need[l])
+					break;
+
+				//bring the next row in, the ones at the end already are
+				int ly = level.next++;
+				if(ly < level.tail)
+				{
+					noisifyRow(level.pixels.keep(ly), level.w, ly, params.seed, format, l);
+					int *rowSources = level.sources.keep(ly);
+					for(int x = 0; x < level.w; x++)
+						rowSources[x] = -1;
+				}
+
+				for(int x = 0; x < level.w; x++)
+				{
+					verboseDebug("\t\tCalculating color at (%d, %d) on level %d\n", x, ly, l);
+					const Uint8 *target = windows[l]->move(pixels[l], &blurred[0], format, x, ly);
+					searchCandidates(&search, l, sources[l], x, ly, candidates);
+
+					int srcX = 0, srcY = 0;
+					Uint32 color = matchNeighborhood(&search, l, target, windows[l]->getStride(), candidates, &srcX, &srcY, true);
+					pixels[l].at(x, ly) = color | PIXEL_OPAQUE;
+					sources[l].at(x, ly) = srcY * inPyramid->getLevel(l)->w + srcX;
+				}
+
+				if(level.blur)
+					level.blur->add(ly, pixels[l].row(ly), format);
+			}
+		}
+
+		//the row is done, so it can go
+		for(int x = 0; x < w; x++)
+			unpackRGB(pixels[0].at(x, y), format, &rgb[x * 3], &rgb[x * 3 + 1], &rgb[x * 3 + 2]);
+		if(fwrite(rgb, 3, w, out) != (size_t)w)
+		{
+			debug("ERROR: couldn't write row %d to %s\n", y, filename);
+			ok = false;
+		}
+
+		//and so can every row above what the next rows of the level read, and every blurred row
+		//above what the next rows of the finer levels read
+		for(int l = 0; l < levels; l++)
+		{
+			stream_level &level = pyramid[l];
+			for(; level.first < MIN(level.next - level.reach, level.tail); level.first++)
+			{
+				level.pixels.drop(level.first);
+				level.sources.drop(level.first);
+			}
+
+			int low = level.h;
+			for(int f = 0; f < l; f++)
+				low = MIN(low, hood::levelPosition(f, l, pyramid[f].next) + level.minY);
+			for(; level.firstBlurred < MIN(low, level.blurredTail); level.firstBlurred++)
+				if(level.firstBlurred >= level.head)
+					level.blurred.drop(level.firstBlurred);
+		}
+
+		totTime += ((double)clock() - start) / CLOCKS_PER_SEC;
+		if(y % 20 == 0)
+			debug("\t\tTwenty rows done. Average time per row: %f s*\n", totTime / (y + 1));
+	}
+
+	if(fclose(out) != 0)
+	{
+		debug("ERROR: couldn't finish writing %s\n", filename);
+		ok = false;
+	}
+
+	debug("Cleaning up\n");
+	for(int l = 0; l < levels; l++)
+	{
+		stream_level &level = pyramid[l];
+		debug("\tKept at most %d of the %d rows of level %d and %d blurred ones\n", level.pixels.peak, level.h, l, level.blurred.peak);
+		level.pixels.release();
+		level.blurred.release();
+		level.sources.release();
+		delete level.blur;
+		delete windows[l];
+	}
+	delete pool;
+	delete[] distances;
+	delete[] rgb;
+	SDL_FreeSurface(like);
+	delete[] noPixels;
+	delete[] noSources;
+	return ok;
+}
+
+SDL_Surface *textureSynthesis(SDL_Surface *inputTexture, int w, int h, const tex_syn_params &params)
+{
+	tex_syn_context context(inputTexture, tex_syn_context::levelsFor(w, h), params);
+	return context.synthesize(w, h, params);
+}
+
+bool streamTextureSynthesis(SDL_Surface *inputTexture, int w, int h, const tex_syn_params &params, const char *filename)
+{
+	tex_syn_context context(inputTexture, tex_syn_context::levelsFor(w, h), params);
+	return context.stream(w, h, params, filename);
+}
@@ -17,43 +17,111 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
-#ifndef TEX_SYN_H_INCLUDED
-#define TEX_SYN_H_INCLUDED
+#ifndef TEX_SYN_H_INCLUDED
+#define TEX_SYN_H_INCLUDED
 
 /*
  * This file contains the functions that will actually perform the texture synthesis.
  * This should be the only file including gauss_pyramid.h.
+ *
+ * Everything the synthesis depends on is in a tex_syn_params, there is no global state
+ * apart from the comparison kernel, which initSSD() picks once when the program starts.
+ * A tex_syn_context analyzes an input texture once and can then synthesize any number of
+ * textures from it, at the same time from different threads if you want, since the
+ * analysis is never changed once it is made.
  */
 
-//NOTE: if you have TEX_SYN_THREADS set to a value > 0, that number of threads
-//		will be used when comparing neighborhoods generating the texture.
-//		This does improve performance a TINY bit but you can't use a seemingly
-//		logical number of threads, like 2 for your dual core. I found that my dual core
-//		processor did best with 22 threads generating a 64 x 64 image with texton size 23
-//		also, you can turn this up higher than the height of your render but it won't use
-//		any more than (height) threads.
-//		the default value can be changed in tex_syn.c or defined on the command line.
-extern int TEX_SYN_THREADS;
-
-//the following preprocessor instructinos will affect the way the texture is synthesized
+//the following preprocessor instructinos only pick the defaults of the matching
+//tex_syn_params, everything can be changed when the synthesis is run.
 //if you want to turn of them off, just comment them out.
 
 //NOTE: if you have TEX_SYN_USE_MULTIRESOLUTION defined, the program will use a
-//		multiresolution synthesis algorthim. If this is not defined, it'll just
-//		generate the texture using only one layer.
+//		multiresolution synthesis algorthim: the output is made one level of its pyramid at
+//		a time and every neighborhood also takes colors from the levels above its own.
+//		If this is not defined, it'll just generate the texture using only one layer.
 #define TEX_SYN_USE_MULTIRESOLUTION
 
 
 
 //NOTE: if you have TEX_SYN_WEIGHTED_COLORS defined, the similarity function will weight
-//		the color differences. The weight is determined by the TEX_SYN_[color]_WEIGHT
-//		defines. The function used is a sum of squared differences. These values factor
+//		the color differences. The weight is determined by the redWeight, greenWeight and
+//		blueWeight params. The function used is a sum of squared differences. These values factor
 //		in at the sum level. It takes the square of the difference for the channel then
-//		multiplies it by the color weight
+//		multiplies it by the color weight. Since w * (a - b)^2 = (sqrt(w) * a - sqrt(w) * b)^2,
+//		the weights are folded into the neighborhoods' 8 bit channels when they are built
+//		and the comparison itself is a plain integer sum of squared differences.
 #define TEX_SYN_WEIGHTED_COLORS
-extern float TEX_SYN_RED_WEIGHT;
-extern float TEX_SYN_GREEN_WEIGHT;
-extern float TEX_SYN_BLUE_WEIGHT;
+
+
+
+//NOTE: search picks how the best matching input neighborhood is found for
+//		every output pixel. It can be changed on the command line.
+//		TEX_SYN_SEARCH_EXHAUSTIVE compares against every neighborhood of the input level.
+//		TEX_SYN_SEARCH_TSVQ builds a tree-structured vector quantization index over the
+//			input neighborhoods of every level (Wei and Levoy's speedup). The tree is at
+//			most tsvqDepth nodes deep and the neighborhoods in the
+//			tsvqLeaves leaves closest to the output neighborhood are compared.
+//			More leaves is slower but closer to the exhaustive result.
+//		TEX_SYN_SEARCH_COHERENCE is Ashikhmin's coherence search. It only tries the input
+//			pixels that the already synthesized neighbors came from, shifted by the offset
+//			to the pixel being synthesized, so its cost only depends on the neighborhood
+//			size. Pixels without any synthesized neighbors fall back on the exhaustive search.
+//		TEX_SYN_SEARCH_KCOHERENCE is Tong et al.'s k-coherence search. Before synthesis, the
+//			kcoherenceK most similar neighborhoods of every input pixel are found.
+//			Every coherence candidate is then tried along with its k similar pixels. Finding
+//			them is as slow as an exhaustive search of the whole input for every input
+//			pixel, so if kcoherenceCache names a file they are saved there and
+//			loaded from there the next time the same input and settings are used.
+//		TEX_SYN_SEARCH_PATCHMATCH is Barnes et al.'s PatchMatch. Instead of going through
+//			the output one pixel at a time, every level starts out with a match for every
+//			pixel (from the coarser level, or random on the coarsest one) that is refined
+//			patchmatchIterations times by propagating good matches to neighbors
+//			and trying random pixels within patchmatchRadius of the current
+//			match (0 means the whole input). The passes are split up by rows between the
+//			threads and each pixel only costs a few comparisons, so it is by far the fastest.
+//		TEX_SYN_SEARCH_FFT gives the same answers as the exhaustive search, but finds the
+//			distance to every input neighborhood at once with ffts (see fftsearch.h). The
+//			cost per pixel only grows with log(input size) instead of the neighborhood
+//			size, so it is the one to use with big neighborhoods.
+//		TEX_SYN_SEARCH_PARALLEL is Lefebvre and Hoppe's parallel synthesis. Every level starts
+//			out with the coarser level's input coordinates, jittered by up to
+//			parallelJitter pixels, and then gets parallelPasses correction
+//			passes that compare whole squares around the pixels against the coherent
+//			candidates (and their kcoherenceK most similar pixels, if k > 0).
+//			Every pixel of a pass is independent of the others, so unlike the other searches
+//			it keeps getting faster with more threads.
+#define TEX_SYN_SEARCH_EXHAUSTIVE	0
+#define TEX_SYN_SEARCH_TSVQ			1
+#define TEX_SYN_SEARCH_COHERENCE	2
+#define TEX_SYN_SEARCH_KCOHERENCE	3
+#define TEX_SYN_SEARCH_PATCHMATCH	4
+#define TEX_SYN_SEARCH_FFT			5
+#define TEX_SYN_SEARCH_PARALLEL		6
+#define TEX_SYN_SEARCHES			7
+
+
+
+//NOTE: order picks the order the output pixels are synthesized in by the searches that
+//		go one pixel at a time (all but patchmatch and parallel).
+//		TEX_SYN_ORDER_SCANLINE does one pixel after the other, splitting up each search
+//			between the threads.
+//		TEX_SYN_ORDER_WAVEFRONT works out which pixels don't read each other's colors from the
+//			shape of the neighborhoods and does all of them at once, one pixel per thread.
+//			The pixels that read each other stay in the same order, so the result is exactly
+//			the same as the scanline order on every level: a pixel reads its own level around
+//			where it is, and the coarser levels it reads are finished before its level is
+//			started (see hood::gather()). With TEX_SYN_EDGES_WRAP the first pixel of a row reads
+//			the last ones of the row above, so on all but the smallest levels every pixel
+//			depends on the one before it and this falls back on the scanline order. It also does for the fft search, which can
+//			only do one pixel at a time. A warning is printed when it does.
+//		edges picks what the output neighborhoods do at the edges of the output.
+//		TEX_SYN_EDGES_WRAP wraps them around to the other side, so the texture tiles.
+//		TEX_SYN_EDGES_CLAMP uses the pixels on the edge instead. The texture won't tile but
+//			the wavefront order has rows of pixels it can do at the same time.
+#define TEX_SYN_ORDER_SCANLINE		0
+#define TEX_SYN_ORDER_WAVEFRONT		1
+#define TEX_SYN_EDGES_WRAP			0
+#define TEX_SYN_EDGES_CLAMP			1
 
 
 
@@ -66,17 +134,160 @@ extern float TEX_SYN_BLUE_WEIGHT;
 #endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>			//strcmp()
 #include "util.h"			//debug()
-#include "sdl.h"			//noisify(), getPixel()
+#include "sdl.h"			//noisify(), surfaceView()
 #include "gauss_pyramid.h"	//gauss_pyramid class
 #include "hood.h"			//hood class
+#include "worker_pool.h"	//worker_pool class
+#include "ssd.h"			//ssdBounded
+#include "tsvq.h"			//tsvq class
+#include "kcoherence.h"		//similarity_sets class
+#include "patchmatch.h"		//patch_match class
+#include "fftsearch.h"		//fft_search class
+#include "parallelsyn.h"		//parallel_synthesis class
+#include "analysis.h"		//analysis_cache class
+
+
+//everything a synthesis can be told. the constructor fills in the defaults.
+struct tex_syn_params
+{
+	tex_syn_params();
+
+	//these are used to analyze the input, they are read by tex_syn_context's constructor.
+	//the searches are explained above.
+	int diameter;
+	bool multiresolution;
+	bool weightedColors;
+	float redWeight, greenWeight, blueWeight;
+	int search;
+	int tsvqDepth;
+	int kcoherenceK;
+	//file the k-coherence similarity sets are kept in, or NULL
+	char *kcoherenceCache;
+	//if this names a directory, the analysis of the input texture (its pyramid, neighborhoods,
+	//tsvq trees and similarity sets) is saved there in a file named after a hash of the input
+	//and the settings it depends on. The next time the same input and settings are analyzed
+	//that file is mapped into memory and used as it is instead of making all of it again
+	//(see analysis.h).
+	char *analysisCache;
+
+	//these are only used by tex_syn_context::synthesize(), so they can be different every time.
+	//if threads is > 0, that many worker threads are started for the synthesis and used to
+	//compare neighborhoods. The input level's rows are split up into one task per thread,
+	//so there is no point in using more threads than you have cores.
+	int threads;
+	int tsvqLeaves;
+	int patchmatchIterations, patchmatchRadius;
+	int parallelPasses;
+	float parallelJitter;
+	int order, edges;
+	//how many bytes of coarse terms the exhaustive search can keep (see coarse_terms in
+	//tex_syn.cpp), at least one parent's are kept if it isn't 0. 0 works them out again for
+	//every pixel. The texture is the same either way, only the time it takes changes.
+	size_t coarseTermsMemory;
+	//where the noise the output starts from and the random numbers of the patchmatch and
+	//parallel searches come from. the same seed always gives the same texture (see random.h).
+	unsigned int seed;
+	//if this isn't NULL it is called with the level being synthesized every so often, from
+	//whichever thread is running the synthesis. progressData is passed along to it.
+	void (*progress)(SDL_Surface *level, void *data);
+	void *progressData;
+};
+
+
+//the analysis of one input texture: its pyramid, neighborhoods and whatever the search
+//needs on top of that. It is never changed once it is made, so synthesize() can be called
+//from any number of threads at the same time.
+class tex_syn_context
+{
+public:
+	//analyzes input for outputs with a pyramid levels levels tall (see levelsFor()), using the
+	//analysis params. input is not copied, it has to stay around as long as the context does.
+	tex_syn_context(SDL_Surface *input, int levels, const tex_syn_params &params);
+	~tex_syn_context();
+
+	//returns a new w x h texture synthesized from the input with the synthesis params.
+	//w x h must be big enough for a pyramid getLevels() tall. the analysis params are
+	//the ones the context was made with, whatever params says.
+	SDL_Surface *synthesize(int w, int h, const tex_syn_params &params) const;
+
+	//synthesizes a w x h texture like synthesize() does and writes it to filename as a
+	//binary ppm, one row at a time as they are finished. Every level of the pyramid is
+	//synthesized a row at a time too, each only as far down as the finer levels read it, and
+	//only the rows that are still going to be read are kept in memory (with
+	//TEX_SYN_EDGES_WRAP the first and last rows of every level too, which the neighborhoods
+	//reach around to). So the memory it takes only depends on w and the diameter, and h can
+	//be as big as the disk allows. w x h must be big enough for a pyramid getLevels() tall.
+	//With one level the texture is the same one synthesize() makes. With more the coarser
+	//levels start out as noise of their own instead of the shrunk noise of the finest one,
+	//and with TEX_SYN_EDGES_WRAP the first rows read the last ones of the coarser levels
+	//before they're synthesized, so it isn't quite.
+	//patchmatch and parallel need whole levels and can't be streamed.
+	//The pixels are always done in scanline order and params.progress isn't called.
+	//returns false if anything went wrong.
+	bool stream(int w, int h, const tex_syn_params &params, const char *filename) const;
 
+	//returns how many levels the pyramid of a w x h texture is
+	static int levelsFor(int w, int h);
+
+	inline int getLevels() const
+	{
+		return levels;
+	}
+
+	//returns about how many bytes the analysis takes up, mapped or not
+	size_t getMemoryUse() const;
+
+private:
+	//no copying, the analysis is ours to free
+	tex_syn_context(const tex_syn_context &);
+	tex_syn_context &operator=(const tex_syn_context &);
+
+	//makes the kcoherenceK most similar pixels of every neighborhood in hoods
+	similarity_sets *makeSimilaritySets(hood_pyramid *hoods, worker_pool *pool, analysis_cache *cached);
+
+	//a hash of the input texture and every setting its analysis depends on
+	Uint64 analysisKey(SDL_Surface *input, float *weights);
+
+	//the analysis params
+	tex_syn_params analysis;
+	hood_settings *settings;
+	int levels;
+
+	gauss_pyramid *inPyramid;
+	hood_pyramid *inHoodPyramid;
+	//the square neighborhoods of the parallel search
+	hood_pyramid *squareHoodPyramid;
+	//the tsvq tree of every level if search is TEX_SYN_SEARCH_TSVQ
+	tsvq **trees;
+	//the k most similar pixels of every input pixel for the k-coherence and parallel searches
+	similarity_sets *similar;
+	//the fft search of every level if search is TEX_SYN_SEARCH_FFT
+	fft_search **ffts;
+	//hood::causalOffsets() of every level
+	vector<int> *causalX, *causalY;
+	//the file all of that might be mapped from
+	analysis_cache *cache;
+};
+
+
+//returns the TEX_SYN_SEARCH_* called name on the command line (like "kcoherence"),
+//or -1 if there isn't one
+int searchNamed(const char *name);
+
+//returns what the TEX_SYN_SEARCH_* search is called on the command line
+const char *searchName(int search);
 
 //Takes input surface and output size and returns an SDL_Surface of the specified
-//size that contains a synthesized texture based off the input SDL_Surface
-SDL_Surface *textureSynthesis(SDL_Surface *inputTexture, int w, int h);
+//size that contains a synthesized texture based off the input SDL_Surface.
+//this just makes a context for the one texture.
+SDL_Surface *textureSynthesis(SDL_Surface *inputTexture, int w, int h, const tex_syn_params &params);
+
+//the same, but streams the texture to filename with tex_syn_context::stream() instead
+bool streamTextureSynthesis(SDL_Surface *inputTexture, int w, int h, const tex_syn_params &params, const char *filename);
+
+
+
 
-
-
-
-#endif // TEX_SYN_H_INCLUDED
+#endif // TEX_SYN_H_INCLUDED
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "tsvq.h"
+#include <string.h>		//memcpy()
+#include <algorithm>	//push_heap(), pop_heap()
+#include <functional>	//greater
+
+tsvq::tsvq(hood_pyramid *hoods, int l, int depth)
+{
+	data = hoods->getLevelData(l);
+	stride = hoods->getStride(l);
+	int count = hoods->getWidth(l) * hoods->getHeight(l);
+
+	//a full tree has 2^depth - 1 nodes but most don't get that far, start small and grow
+	centroids = NULL;
+	centroidSpace = 0;
+
+	indices.resize(count);
+	for(int i = 0; i < count; i++)
+		indices[i] = i;
+
+	verboseDebug("\tBuilding a TSVQ tree of depth %d over %d neighborhoods on level %d\n", depth, count, l);
+	build(0, count, MAX(depth, 1));
+	verboseDebug("\tdone. %d nodes\n", nodes.size());
+
+	nodeData = &nodes[0];
+	indexData = &indices[0];
+	centroidData = centroids;
+	nodeCount = nodes.size();
+}
+
+tsvq::tsvq(hood_pyramid *hoods, int l, const tsvq_node *n, int count, const int *i, const Uint8 *c)
+{
+	data = hoods->getLevelData(l);
+	stride = hoods->getStride(l);
+	centroids = NULL;
+	centroidSpace = 0;
+
+	nodeData = n;
+	nodeCount = count;
+	indexData = i;
+	centroidData = c;
+}
+
+tsvq::~tsvq()
+{
+	alignedFree(centroids);
+}
+
+int tsvq::build(int first, int count, int depth)
+{
+	int n = nodes.size();
+	tsvq_node node;
+	node.children[0] = node.children[1] = -1;
+	node.first = first;
+	node.count = count;
+	nodes.push_back(node);
+
+	//make room for this node's codeword
+	if(n >= centroidSpace)
+	{
+		int newSpace = MAX(64, centroidSpace * 2);
+		Uint8 *newCentroids = (Uint8*) alignedAlloc((size_t)newSpace * stride, SSD_ALIGN);
+		if(centroids)
+		{
+			memcpy(newCentroids, centroids, (size_t)centroidSpace * stride);
+			alignedFree(centroids);
+		}
+		centroids = newCentroids;
+		centroidSpace = newSpace;
+	}
+	mean(first, count, getCentroid(n));
+
+	//stop here if this is as deep as it goes or there is nothing to split
+	if(depth <= 1 || count < 2)
+		return n;
+
+	//seed the two clusters with two neighborhoods that are far apart: the one farthest from
+	//the mean and then the one farthest from that one
+	int seeds[2] = { indices[first], indices[first] };
+	for(int s = 0; s < 2; s++)
+	{
+		const Uint8 *from = (s == 0) ? getCentroid(n) : getHood(seeds[0]);
+		Uint64 farthest = 0;
+		for(int i = first; i < first + count; i++)
+		{
+			Uint64 d = ssd(from, getHood(indices[i]), stride);
+			if(d > farthest)
+			{
+				farthest = d;
+				seeds[s] = indices[i];
+			}
+		}
+	}
+	//every neighborhood here is the same
+	if(seeds[0] == seeds[1] || ssd(getHood(seeds[0]), getHood(seeds[1]), stride) == 0)
+		return n;
+
+	Uint8 *split[2];
+	for(int c = 0; c < 2; c++)
+	{
+		split[c] = (Uint8*) alignedAlloc(stride, SSD_ALIGN);
+		memcpy(split[c], getHood(seeds[c]), stride);
+	}
+
+	//2-means: put every neighborhood with its closest center, then move the centers to the
+	//middle of their neighborhoods and do it again
+	int half = 0;
+	for(int it = 0; it < TSVQ_ITERATIONS; it++)
+	{
+		//partition [first, first + count) so the ones closer to split[0] come first
+		int lo = first, hi = first + count - 1;
+		while(lo <= hi)
+		{
+			const Uint8 *h = getHood(indices[lo]);
+			if(ssd(h, split[0], stride) <= ssd(h, split[1], stride))
+				lo++;
+			else
+			{
+				int tmp = indices[lo];
+				indices[lo] = indices[hi];
+				indices[hi] = tmp;
+				hi--;
+			}
+		}
+		half = lo - first;
+
+		//one side is empty, can't do any better than this
+		if(half == 0 || half == count)
+			break;
+
+		mean(first, half, split[0]);
+		mean(first + half, count - half, split[1]);
+	}
+	alignedFree(split[0]);
+	alignedFree(split[1]);
+
+	if(half == 0 || half == count)
+		return n;
+
+	//careful, nodes can move around while the children are built
+	int left = build(first, half, depth - 1);
+	int right = build(first + half, count - half, depth - 1);
+	nodes[n].children[0] = left;
+	nodes[n].children[1] = right;
+	return n;
+}
+
+void tsvq::mean(int first, int count, Uint8 *centroid)
+{
+	vector<Uint32> sums(stride, 0);
+	for(int i = first; i < first + count; i++)
+	{
+		const Uint8 *h = getHood(indices[i]);
+		for(int j = 0; j < stride; j++)
+			sums[j] += h[j];
+	}
+	for(int j = 0; j < stride; j++)
+		centroid[j] = (count > 0) ? (Uint8)((sums[j] + count / 2) / count) : 0;
+}
+
+int tsvq::search(const Uint8 *target, int leaves, Uint64 *dist)
+{
+	int best = -1;
+	Uint64 bestDist = ~(Uint64)0;
+
+	//best bin first: always walk down towards the closer child and remember the other one
+	//so it can be visited later if more leaves are wanted
+	typedef pair<Uint64, int> branch;
+	vector<branch> heap;
+	heap.push_back(branch(0, 0));
+
+	for(int visited = 0; visited < MAX(leaves, 1) && !heap.empty(); visited++)
+	{
+		pop_heap(heap.begin(), heap.end(), greater<branch>());
+		int n = heap.back().second;
+		heap.pop_back();
+
+		while(nodeData[n].children[0] >= 0)
+		{
+			int c0 = nodeData[n].children[0], c1 = nodeData[n].children[1];
+			Uint64 d0 = ssd(target, centroidData + (size_t)c0 * stride, stride);
+			Uint64 d1 = ssd(target, centroidData + (size_t)c1 * stride, stride);
+			if(d0 <= d1)
+			{
+				heap.push_back(branch(d1, c1));
+				n = c0;
+			}
+			else
+			{
+				heap.push_back(branch(d0, c0));
+				n = c1;
+			}
+			push_heap(heap.begin(), heap.end(), greater<branch>());
+		}
+
+		//compare the real neighborhoods in this leaf
+		ssd_bounded_func compare = fixedBoundedSSD(stride);
+		for(int i = nodeData[n].first; i < nodeData[n].first + nodeData[n].count; i++)
+		{
+			//anything farther than the best so far can't win, so stop adding it up as soon as it is
+			Uint64 d = compare(target, getHood(indexData[i]), stride, bestDist);
+			//ties go to the earlier position so the answer doesn't depend on the tree's order
+			if(d < bestDist || (d == bestDist && indexData[i] < best))
+			{
+				bestDist = d;
+				best = indexData[i];
+			}
+		}
+	}
+
+	if(dist)
+		*dist = bestDist;
+	return best;
+}
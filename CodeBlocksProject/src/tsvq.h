@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef TSVQ_H_INCLUDED
+#define TSVQ_H_INCLUDED
+
+/*
+ * This file contains the tree-structured vector quantization index that Wei and Levoy
+ * use to speed up the neighborhood search. Every node of the tree holds the mean
+ * (codeword) of the neighborhoods below it and splits them in two with a 2-means
+ * clustering. A search walks down towards the closest codewords and only compares
+ * the real neighborhoods that ended up in the leaves it visited.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "util.h"	//debug()
+#include "hood.h"	//hood_pyramid class
+#include "ssd.h"	//ssd()
+
+using namespace std;
+
+//how many rounds of 2-means clustering are used to split a node
+#define TSVQ_ITERATIONS 4
+
+class tsvq
+{
+public:
+	struct tsvq_node
+	{
+		//index of the two children in nodes, -1 for leaves
+		int children[2];
+		//the range of indices that are below this node
+		int first, count;
+	};
+
+	//builds a tree over all the neighborhoods on level l of hoods. it will be at most depth
+	//nodes deep, nodes with only one neighborhood are not split any further.
+	tsvq(hood_pyramid *hoods, int l, int depth);
+
+	//uses a tree that was already built somewhere else (like a mapped analysis cache) from
+	//the getNodeData(), getIndexData() and getCentroidData() of the tree it was built as.
+	//they aren't copied, so they have to stay around as long as this does.
+	tsvq(hood_pyramid *hoods, int l, const tsvq_node *nodes, int nodeCount, const int *indices, const Uint8 *centroids);
+	~tsvq();
+
+	//looks for the neighborhood that is most like target (which must be padded out to the
+	//level's stride). the leaves closest to target are visited first and the neighborhoods
+	//of the first leaves of them are compared exactly. returns the index (y * width + x)
+	//of the best one and sets *dist to its distance.
+	int search(const Uint8 *target, int leaves, Uint64 *dist);
+
+	//returns how many nodes are in the tree
+	inline int getNodes()
+	{
+		return nodeCount;
+	}
+
+	//the tree, so it can be saved. getNodes() nodes, one index per neighborhood of the level
+	//and getNodes() codewords of the level's stride bytes.
+	inline const tsvq_node *getNodeData()
+	{
+		return nodeData;
+	}
+	inline const int *getIndexData()
+	{
+		return indexData;
+	}
+	inline const Uint8 *getCentroidData()
+	{
+		return centroidData;
+	}
+
+private:
+	//makes a node for indices [first, first + count) and splits it if it can
+	//returns its index in nodes
+	int build(int first, int count, int depth);
+
+	//sets centroid to the rounded mean of the neighborhoods at indices [first, first + count)
+	void mean(int first, int count, Uint8 *centroid);
+
+	//returns the neighborhood at index i of the level
+	inline const Uint8 *getHood(int i)
+	{
+		return data + (size_t)i * stride;
+	}
+
+	//returns the codeword of node n
+	inline Uint8 *getCentroid(int n)
+	{
+		return centroids + (size_t)n * stride;
+	}
+
+	//the tree while it's built
+	vector<tsvq_node> nodes;
+	//neighborhood indices, grouped so every node's are next to each other
+	vector<int> indices;
+	//one codeword per node, stride bytes each. grows as nodes are added
+	Uint8 *centroids;
+	int centroidSpace;
+
+	//the tree search() uses, either the one above or one from somewhere else
+	const tsvq_node *nodeData;
+	const int *indexData;
+	const Uint8 *centroidData;
+	int nodeCount;
+
+	const Uint8 *data;
+	int stride;
+};
+
+#endif // TSVQ_H_INCLUDED
@@ -18,18 +18,31 @@
  */
 
 #include "util.h"
+#ifdef _WIN32
+	#include <malloc.h>	//_aligned_malloc()
+#endif
+#ifdef _MSC_VER
+	#include <intrin.h>	//_InterlockedIncrement()
+#endif
+
+//every line that is printed gets the next number, whichever thread prints it
+static volatile long callNo = 0;
+static long nextCallNo()
+{
+#ifdef _MSC_VER
+	return _InterlockedIncrement(&callNo) - 1;
+#else
+	return __sync_fetch_and_add(&callNo, 1);
+#endif
+}
 
-int textonDiameter = 0;
-
-int callNo = 0;
 int debug(char *format, ...)
 {
 	if(VERBOSITY < 1)
 		return 0;
 
 	int toReturn = 0;
-	printf("%06d: ", callNo);
-	callNo++;
+	printf("%06ld: ", nextCallNo());
 
 	//... option stuff
 	va_list ap;
@@ -52,8 +65,7 @@ int verboseDebug(char *format, ...)
 		return 0;
 
 	int toReturn = 0;
-	printf("%06d: ", callNo);
-	callNo++;
+	printf("%06ld: ", nextCallNo());
 
 	va_list ap;
 	va_start(ap, format);
@@ -68,3 +80,29 @@ int verboseDebug(char *format, ...)
 
 	return toReturn;
 }
+
+void *alignedAlloc(size_t size, size_t align)
+{
+	void *toReturn = NULL;
+#ifdef _WIN32
+	toReturn = _aligned_malloc(size, align);
+#else
+	if(posix_memalign(&toReturn, align, size) != 0)
+		toReturn = NULL;
+#endif
+	if(!toReturn && size > 0)
+	{
+		fprintf(stderr, "ERROR allocating %lu aligned bytes\n", (unsigned long) size);
+		exit(EXIT_FAILURE);
+	}
+	return toReturn;
+}
+
+void alignedFree(void *ptr)
+{
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
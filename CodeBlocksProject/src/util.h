@@ -33,10 +33,6 @@
 #include <stdlib.h>
 #include <stdarg.h>
 
-//this is how many colors to sample when generating a neighborhood.
-//it is always set in the command line options.
-extern int textonDiameter;
-
 //got a little help with the printf wrapper from the following website
 // http://bytes.com/topic/c/answers/220856-printf-wrapper
 
@@ -47,6 +43,11 @@ int debug(char *format, ...);
 //note: all "done" messages should be printed using this function.
 int verboseDebug(char *format, ...);
 
+//allocates size bytes that start on an align byte boundary (align must be a power of two).
+//exits the program if the memory can't be had. free it with alignedFree().
+void *alignedAlloc(size_t size, size_t align = 64);
+void alignedFree(void *ptr);
+
 #ifndef MAX
 #define MAX(x,y) ((x) < (y) ? (y) : (x))
 #endif
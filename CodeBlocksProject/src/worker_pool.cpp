@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "worker_pool.h"
+
+worker_pool::worker_pool(int numThreads)
+{
+	task = NULL;
+	taskData = NULL;
+	nextTask = taskCount = tasksLeft = 0;
+	quitting = false;
+
+	mut = SDL_CreateMutex();
+	workReady = SDL_CreateCond();
+	workDone = SDL_CreateCond();
+	if(!mut || !workReady || !workDone)
+	{
+		fprintf(stderr, "ERROR creating worker pool synchronization objects: %s\n", SDL_GetError());
+		exit(EXIT_FAILURE);
+	}
+
+	verboseDebug("Starting %d worker threads\n", numThreads);
+	for(int t = 0; t < numThreads; t++)
+	{
+		SDL_Thread *thread = SDL_CreateThread(workerMain, (void*)this);
+		if(!thread)
+		{
+			//not fatal, just means the other threads get more work
+			debug("WARNING: could only start %d of %d worker threads: %s\n", t, numThreads, SDL_GetError());
+			break;
+		}
+		threads.push_back(thread);
+	}
+}
+
+worker_pool::~worker_pool()
+{
+	//wake everyone up and tell them to leave
+	SDL_mutexP(mut);
+	quitting = true;
+	SDL_CondBroadcast(workReady);
+	SDL_mutexV(mut);
+
+	for(int t = 0; t < threads.size(); t++)
+	{
+		int rs = 0;
+		SDL_WaitThread(threads[t], &rs);
+		if(rs != 0)
+			debug("WARNING: worker thread #%d returned status %d!\n", t, rs);
+	}
+
+	SDL_DestroyCond(workDone);
+	SDL_DestroyCond(workReady);
+	SDL_DestroyMutex(mut);
+}
+
+void worker_pool::run(pool_task t, void *data, int count)
+{
+	if(count <= 0)
+		return;
+
+	//no threads, just do it all here
+	if(threads.empty())
+	{
+		for(int i = 0; i < count; i++)
+			t(i, data);
+		return;
+	}
+
+	//hand out the new batch
+	SDL_mutexP(mut);
+	task = t;
+	taskData = data;
+	nextTask = 0;
+	taskCount = count;
+	tasksLeft = count;
+	SDL_CondBroadcast(workReady);
+
+	//pitch in until there is nothing left to hand out
+	while(runNextTask());
+
+	//then wait for the stragglers
+	while(tasksLeft > 0)
+		SDL_CondWait(workDone, mut);
+
+	//forget about the batch so nobody runs it again
+	task = NULL;
+	taskData = NULL;
+	SDL_mutexV(mut);
+}
+
+bool worker_pool::runNextTask()
+{
+	if(nextTask >= taskCount)
+		return false;
+
+	//take the task and drop the lock while it runs
+	int i = nextTask++;
+	pool_task t = task;
+	void *data = taskData;
+	SDL_mutexV(mut);
+
+	t(i, data);
+
+	SDL_mutexP(mut);
+	tasksLeft--;
+	if(tasksLeft == 0)
+		SDL_CondSignal(workDone);
+	return true;
+}
+
+int worker_pool::workerMain(void *data)
+{
+	worker_pool *pool = (worker_pool*) data;
+
+	SDL_mutexP(pool->mut);
+	while(!pool->quitting)
+	{
+		//do whatever work there is, then go to sleep until there is more
+		if(!pool->runNextTask())
+			SDL_CondWait(pool->workReady, pool->mut);
+	}
+	SDL_mutexV(pool->mut);
+
+	return 0;
+}
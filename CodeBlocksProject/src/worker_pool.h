@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) (2009) (Joseph Balough) <jbb5044@psu.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef WORKER_POOL_H_INCLUDED
+#define WORKER_POOL_H_INCLUDED
+
+/*
+ * This file contains a small pool of long-lived SDL threads. The threads are made
+ * once and then handed batches of tasks, so nothing has to create or wait on a
+ * thread for every pixel that gets synthesized.
+ */
+
+#ifdef __APPLE__
+    #include <SDL/SDL.h>
+    #include <SDL/SDL_thread.h>
+#else
+    #include <SDL.h>
+    #include <SDL_thread.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "util.h"	//debug()
+
+using namespace std;
+
+//the function type run by the pool. it is given the index of the task
+//in the batch and the data pointer that was handed to run()
+typedef void (*pool_task)(int i, void *data);
+
+class worker_pool
+{
+public:
+	//starts up numThreads worker threads that wait for work.
+	//if numThreads is 0, no threads are made and run() does everything
+	//in the calling thread.
+	worker_pool(int numThreads);
+
+	//tells all the threads to quit and waits for them to do so
+	~worker_pool();
+
+	//runs task(i, data) for every i in [0, count) and only returns once every
+	//one of them is done. the calling thread helps out with the tasks too.
+	void run(pool_task task, void *data, int count);
+
+	//returns how many worker threads are in the pool
+	inline int getThreads()
+	{
+		return threads.size();
+	}
+
+private:
+	//the function all the SDL threads are started in
+	static int workerMain(void *data);
+
+	//grabs the next task from the batch and runs it. returns false if there was nothing left.
+	//mut must be locked when this is called and it will be locked when it returns
+	bool runNextTask();
+
+	vector<SDL_Thread*> threads;
+
+	//protects everything below it
+	SDL_mutex *mut;
+	//signaled when a new batch is ready or when it is time to quit
+	SDL_cond *workReady;
+	//signaled when the last task of a batch is finished
+	SDL_cond *workDone;
+
+	//the current batch
+	pool_task task;
+	void *taskData;
+	int nextTask, taskCount, tasksLeft;
+
+	bool quitting;
+};
+
+#endif // WORKER_POOL_H_INCLUDED
@@ -0,0 +1,12 @@
+#!/bin/bash
+
+#run the self test on all the sample textures, one after the other
+#diameter 11 is big enough for the exhaustive search to keep its coarse terms
+failed=0
+for infile in `ls sampleTextures | grep -v '\.zip$'`; do
+  if ! ./bin/Debug/TextureSynthesis sampleTextures/$infile 11 32 --self-test --seed=1; then
+    echo "Self test FAILED on $infile"
+    failed=1
+  fi
+done
+exit $failed